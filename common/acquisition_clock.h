@@ -0,0 +1,92 @@
+#pragma once
+#include "esphome.h"
+
+// The maximum number of components a single clock can drive
+#ifndef ACQUISITION_CLOCK_MAX_COMPONENTS
+#define ACQUISITION_CLOCK_MAX_COMPONENTS 16
+#endif
+
+/*
+ * A shared acquisition clock for the polling sensor components in this repository (Sen0590,
+ * LeafWetness). Instead of every component owning its own interval timer, the clock is the only
+ * thing scheduled: each time it ticks it calls update() on every component registered with it,
+ * optionally only every Nth tick, apart from any which have failed (which ESPHome no longer runs). All the sensors start their measurements on the same tick, so
+ * their sample times line up when comparing them (e.g. tank level against leaf wetness).
+ *
+ * The table of components is a fixed size array (ACQUISITION_CLOCK_MAX_COMPONENTS, which can be
+ * changed with a build flag) so nothing is allocated from the heap.
+ *
+ * Add the include under `esphome:` along with the components it drives
+ *
+ * ```
+ * includes:
+ *   - custom_components/common/acquisition_clock.h
+ * ```
+ *
+ * and create the clock in the same lambda as the sensors. add() must be called from the lambda
+ * (i.e. before App.setup()) as it turns off the component's own update interval.
+ *
+ * ```
+ * sensor:
+ *   - platform: custom
+ *     lambda: |-
+ *       static AcquisitionClock clock(1000);
+ *       static Sen0590 level(1000);
+ *       static LeafWetness leaf(1000);
+ *       App.register_component(&clock);
+ *       App.register_component(&level);
+ *       App.register_component(&leaf);
+ *       clock.add(&level); // every second
+ *       clock.add(&leaf, 5); // every fifth second
+ *       return {&level, &leaf.temperature_sensor, &leaf.wetness_sensor};
+ * ```
+ */
+class AcquisitionClock : public PollingComponent {
+    public:
+    AcquisitionClock(int pollingInterval) : PollingComponent(pollingInterval) {}
+
+    // Drive a component from the clock, calling its update() every `divisor` ticks
+    bool add(PollingComponent *component, uint16_t divisor = 1) {
+        if (divisor == 0) {
+            ESP_LOGE("acquisition_clock", "Can't add component, its divisor is 0");
+            return false;
+        }
+        if (count >= ACQUISITION_CLOCK_MAX_COMPONENTS) {
+            ESP_LOGE("acquisition_clock", "Can't add component, the clock is full");
+            return false;
+        }
+        component->set_update_interval(SCHEDULER_DONT_RUN);
+        components[count].component = component;
+        components[count].divisor = divisor;
+        count++;
+        return true;
+    }
+
+    float get_setup_priority() const override { return esphome::setup_priority::DATA; }
+
+    void dump_config() override {
+        ESP_LOGCONFIG("acquisition_clock", "Acquisition Clock:");
+        ESP_LOGCONFIG("acquisition_clock", "  Interval: %u ms", (unsigned) get_update_interval());
+        ESP_LOGCONFIG("acquisition_clock", "  Components: %u", (unsigned) count);
+    }
+
+    // Update the components due on this tick, skipping any which have failed as ESPHome would
+    void update() override {
+        for (uint8_t i = 0; i < count; i++) {
+            if (tick % components[i].divisor == 0 && !components[i].component->is_failed()) {
+                components[i].component->update();
+            }
+        }
+        tick++;
+    }
+
+    protected:
+    struct Entry {
+        PollingComponent *component;
+        uint16_t divisor; // Update the component every divisor ticks
+    };
+
+    Entry components[ACQUISITION_CLOCK_MAX_COMPONENTS];
+    uint8_t count = 0; // The number of components registered
+    uint32_t tick = 0; // The number of times the clock has ticked
+};
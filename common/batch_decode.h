@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BATCH_DECODE_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BATCH_DECODE_NEON
+#endif
+
+/*
+ * Decodes arrays of raw payloads, as read from many sensors in a cycle or received in telemetry, in
+ * one pass. The raw bytes are contiguous and exactly as the sensors send them:
+ *
+ * - SEN0590: 2 bytes, the big-endian distance in mm
+ * - Tinovi leaf sensor: 4 bytes, the little-endian wetness then temperature in hundredths
+ *
+ * Only the raw readings are decoded, as the sensors sent them (what the components publish on their
+ * raw channels): the calibration and temperature compensation the components apply, and their
+ * checks that a reading is plausible, aren't done, so e.g. a SEN0590 distance is 10mm short of the
+ * one the component publishes and 0xFFFF isn't rejected.
+ *
+ * On the host they're decoded with SSE2 (x86) or NEON (64-bit ARM, e.g. a Raspberry Pi gateway)
+ * several payloads at a time, elsewhere (including on the ESPs) a payload at a time. The results are
+ * identical either way - the conversion to % and degrees is a division (rather than a
+ * multiplication by 0.01, which rounds differently). host/decode_bench.cpp compares it with decoding
+ * a payload at a time.
+ *
+ * The ESP32-S3's vector instructions aren't used as the compilers don't expose them to C++.
+ */
+
+// The distances in mm from `count` SEN0590 payloads
+inline void sen0590_decode_batch(const uint8_t *raw, size_t count, uint16_t *distances) {
+    size_t i = 0;
+#if defined(BATCH_DECODE_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (raw + i * 2));
+        // Swap the bytes of each 16-bit lane
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(bytes, 8), _mm_srli_epi16(bytes, 8));
+        _mm_storeu_si128((__m128i *) (distances + i), swapped);
+    }
+#elif defined(BATCH_DECODE_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x16_t bytes = vld1q_u8(raw + i * 2);
+        vst1q_u16(distances + i, vreinterpretq_u16_u8(vrev16q_u8(bytes)));
+    }
+#endif
+    for (; i < count; i++) {
+        distances[i] = (raw[i * 2] << 8) | raw[i * 2 + 1];
+    }
+}
+
+// The wetness in % and temperature in degrees from `count` Tinovi leaf sensor payloads
+inline void leaf_decode_batch(const uint8_t *raw, size_t count, float *wetness, float *temperature) {
+    size_t i = 0;
+#if defined(BATCH_DECODE_SSE2)
+    const __m128 hundred = _mm_set1_ps(100.0f);
+    for (; i + 4 <= count; i += 4) {
+        // Each 32-bit lane is a payload, the wetness in the low half and the temperature in the high
+        __m128i payloads = _mm_loadu_si128((const __m128i *) (raw + i * 4));
+        __m128i wet = _mm_srai_epi32(_mm_slli_epi32(payloads, 16), 16);
+        __m128i temp = _mm_srai_epi32(payloads, 16);
+        _mm_storeu_ps(wetness + i, _mm_div_ps(_mm_cvtepi32_ps(wet), hundred));
+        _mm_storeu_ps(temperature + i, _mm_div_ps(_mm_cvtepi32_ps(temp), hundred));
+    }
+#elif defined(BATCH_DECODE_NEON)
+    const float32x4_t hundred = vdupq_n_f32(100.0f);
+    for (; i + 8 <= count; i += 8) {
+        // Load the payloads de-interleaved into the wetnesses and the temperatures
+        int16x8x2_t payloads = vld2q_s16((const int16_t *) (raw + i * 4));
+        vst1q_f32(wetness + i, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(payloads.val[0]))), hundred));
+        vst1q_f32(wetness + i + 4, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(payloads.val[0]))), hundred));
+        vst1q_f32(temperature + i, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(payloads.val[1]))), hundred));
+        vst1q_f32(temperature + i + 4, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(payloads.val[1]))), hundred));
+    }
+#endif
+    for (; i < count; i++) {
+        int16_t wet = (int16_t) (raw[i * 4] | (raw[i * 4 + 1] << 8));
+        int16_t temp = (int16_t) (raw[i * 4 + 2] | (raw[i * 4 + 3] << 8));
+        wetness[i] = wet / 100.0f;
+        temperature[i] = temp / 100.0f;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "esphome.h"
+#include "esphome/components/i2c/i2c_bus.h"
+#include "i2c_bus.h"
+
+/*
+ * An I2CBus on a bus defined by ESPHome's `i2c:` component, so the components can use any of the
+ * buses in the configuration (and ESPHome's ESP-IDF driver) instead of the Wire global:
+ *
+ * ```
+ * i2c:
+ *   - id: bus_b
+ *     sda: GPIO25
+ *     scl: GPIO26
+ * ```
+ *
+ * ```
+ * static ESPHomeI2CBus busB(id(bus_b));
+ * static Sen0590 level(1000);
+ * level.set_bus(&busB);
+ * ```
+ *
+ * Registers are read with a repeated start.
+ */
+class ESPHomeI2CBus : public I2CBus {
+    public:
+    ESPHomeI2CBus(i2c::I2CBus *bus) : bus(bus) {}
+
+    void wait(uint32_t ms) override { delay(ms); }
+    uint32_t micros() override { return ::micros(); }
+
+    protected:
+    i2c::I2CBus *bus;
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        return status(bus->write(address, data, length, true));
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        return status(bus->read(address, data, length));
+    }
+    I2CStatus do_write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) override {
+        I2CStatus result = status(bus->write(address, data, length, false));
+        return result == I2CStatus::OK ? status(bus->read(address, buffer, size)) : result;
+    }
+
+    static I2CStatus status(i2c::ErrorCode error) {
+        switch (error) {
+            case i2c::ERROR_OK:
+                return I2CStatus::OK;
+            case i2c::ERROR_NOT_ACKNOWLEDGED:
+                return I2CStatus::NACK;
+            default:
+                return I2CStatus::ERROR;
+        }
+    }
+};
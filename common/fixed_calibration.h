@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * A per-device correction `offset + scale * x + quadratic * x^2` for a sensor's integer readings,
+ * done in fixed point so calibrating each device doesn't need a chain of float filters in YAML.
+ * The coefficients are converted from floats once when it's configured; offset and scale are
+ * stored with 16 fractional bits and quadratic (which is usually tiny) with 32.
+ *
+ * The readings and the result are in the sensor's own units (e.g. mm, or hundredths of a degree).
+ *
+ * The coefficients have to fit their fixed point: offset and scale between -32768 and 32768
+ * (exclusive) and quadratic between -0.5 and 0.5, for readings from -32768 to 32767. fits() tells
+ * whether they do, and ones which don't are clamped to the nearest value that fits.
+ */
+struct FixedCalibration {
+    int32_t offset; // 16 fractional bits
+    int32_t scale; // 16 fractional bits
+    int32_t quadratic; // 32 fractional bits
+
+    constexpr FixedCalibration(float offset = 0.0f, float scale = 1.0f, float quadratic = 0.0f)
+        : offset(to_fixed(offset, 65536.0f)), scale(to_fixed(scale, 65536.0f)),
+          quadratic(to_fixed(quadratic, 4294967296.0f)) {}
+
+    // Correct a reading, rounding to the nearest unit
+    int32_t apply(int32_t x) const {
+        int64_t y = (int64_t) offset + (int64_t) scale * x + (((int64_t) quadratic * x) * x >> 16);
+        return (int32_t) ((y + (1 << 15)) >> 16);
+    }
+
+    // Whether the coefficients can be represented, rather than clamped
+    static constexpr bool fits(float offset, float scale = 1.0f, float quadratic = 0.0f) {
+        return offset > -32768.0f && offset < 32768.0f && scale > -32768.0f && scale < 32768.0f &&
+               quadratic > -0.5f && quadratic < 0.5f;
+    }
+
+    // Convert to fixed point, clamping to the range of int32_t (and NaN to 0) as the conversion of
+    // a float which doesn't fit is undefined
+    static constexpr int32_t to_fixed(float value, float one) {
+        return !(value == value) ? 0
+               : value * one >= 2147483647.0f ? INT32_MAX
+               : value * one <= -2147483648.0f ? INT32_MIN
+               : (int32_t) (value * one + (value < 0 ? -0.5f : 0.5f));
+    }
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include "esphome.h"
+#include "esphome/components/web_server_base/web_server_base.h"
+#include "sample_history.h"
+
+// The maximum number of histories that can be exported
+#ifndef HISTORY_EXPORT_MAX_SOURCES
+#define HISTORY_EXPORT_MAX_SOURCES 16
+#endif
+
+/*
+ * Serves the sample histories of the sensor components (see sample_history.h) from ESPHome's web
+ * server, so their full resolution data can be downloaded for analysis without going through Home
+ * Assistant's recorder:
+ *
+ * - `/history/` lists the histories
+ * - `/history/<name>.csv` is a CSV file with the uptime in ms and the channels of each sample
+ * - `/history/<name>.bin` is a binary frame in the format described in sample_history.h, with a
+ *   boot id picked at random when the node starts, so the host tools can tell its boots apart
+ *
+ * The response is generated a chunk at a time straight from the ring buffer as the web server asks
+ * for it, so it doesn't take more RAM however many samples there are. Only the samples that were
+ * there when the download started are sent, and any overwritten while it's sent are skipped.
+ *
+ * It needs the `web_server:` component and the Arduino framework (for the chunked responses of
+ * ESPAsyncWebServer). The histories are kept when the drivers are built with
+ * `-DCUSTOM_COMPONENTS_HISTORY`. Add the includes under `esphome:`
+ *
+ * ```
+ * includes:
+ *   - custom_components/common/sample_history.h
+ *   - custom_components/common/history_export.h
+ * ```
+ *
+ * and add each sensor's history in the lambda:
+ *
+ * ```
+ * static HistoryExport history;
+ * App.register_component(&history);
+ * history.add("tank", &level.history);
+ * history.add("leaf_61", &leaf.history);
+ * ```
+ */
+class HistoryExport : public Component, public AsyncWebHandler {
+    public:
+    // Serve a history as /history/<name>.csv and .bin, the name needs to stay valid
+    bool add(const char *name, const SampleHistory *history) {
+        if (count >= HISTORY_EXPORT_MAX_SOURCES || strlen(name) > HISTORY_FRAME_NAME_LENGTH) {
+            ESP_LOGE("history_export", "Can't add history %s", name);
+            return false;
+        }
+        sources[count].name = name;
+        sources[count].history = history;
+        count++;
+        return true;
+    }
+
+    float get_setup_priority() const override { return esphome::setup_priority::AFTER_WIFI; }
+
+    void setup() override {
+        // After the WiFi is up, so the hardware random number generator is seeded
+        boot = random_uint32();
+        web_server_base::global_web_server_base->add_handler(this);
+    }
+
+    void dump_config() override {
+        ESP_LOGCONFIG("history_export", "History Export:");
+        for (uint8_t i = 0; i < count; i++) {
+            ESP_LOGCONFIG("history_export", "  /history/%s: %u samples of %s", sources[i].name,
+                (unsigned) sources[i].history->capacity, sources[i].history->columns);
+        }
+    }
+
+    bool canHandle(AsyncWebServerRequest *request) override {
+        return request->method() == HTTP_GET && request->url().startsWith("/history/");
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override {
+        String path = request->url().substring(strlen("/history/"));
+        if (path.length() == 0) {
+            send_list(request);
+            return;
+        }
+        bool binary = path.endsWith(".bin");
+        if (!binary && !path.endsWith(".csv")) {
+            request->send(404);
+            return;
+        }
+        path = path.substring(0, path.length() - 4);
+        for (uint8_t i = 0; i < count; i++) {
+            if (path == sources[i].name) {
+                send_history(request, sources[i], binary);
+                return;
+            }
+        }
+        request->send(404);
+    }
+
+    protected:
+    struct Source {
+        const char *name;
+        const SampleHistory *history;
+    };
+
+    Source sources[HISTORY_EXPORT_MAX_SOURCES];
+    uint8_t count = 0; // The number of histories added
+    uint32_t boot = 0; // Picked at random when the node starts, sent in the frames
+
+    void send_list(AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("text/plain");
+        for (uint8_t i = 0; i < count; i++) {
+            response->printf("%s %u/%u %s\n", sources[i].name, (unsigned) (sources[i].history->total() -
+                sources[i].history->oldest()), (unsigned) sources[i].history->capacity, sources[i].history->columns);
+        }
+        request->send(response);
+    }
+
+    void send_history(AsyncWebServerRequest *request, const Source &source, bool binary) {
+        const SampleHistory *history = source.history;
+        uint32_t next = history->oldest();
+        uint32_t end = history->total();
+        bool started = false; // Whether the header has been sent
+        HistoryFrameHeader header;
+        header.channels = history->channels;
+        header.divisor = history->divisor;
+        header.now = millis();
+        header.boot = boot;
+        strncpy(header.name, source.name, sizeof(header.name));
+        AsyncWebServerResponse *response = request->beginChunkedResponse(binary ? "application/octet-stream" : "text/csv",
+            [history, header, binary, next, end, started](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+                size_t length = 0;
+                if (!started) {
+                    length = binary ? write_header(buffer, maxLen, header) : write_csv_header(buffer, maxLen, history);
+                    if (length == 0) {
+                        return RESPONSE_TRY_AGAIN;
+                    }
+                    started = true;
+                }
+                // Samples which have been overwritten since the download started are skipped
+                uint32_t oldest = history->oldest();
+                if (next < oldest) {
+                    next = oldest;
+                }
+                while (next < end) {
+                    int written = binary ? write_binary(buffer + length, maxLen - length, history, next) :
+                        write_csv(buffer + length, maxLen - length, history, next);
+                    if (written < 0) {
+                        break;
+                    }
+                    length += written;
+                    next++;
+                }
+                // Returning 0 would end the download
+                if (length == 0 && next < end) {
+                    return RESPONSE_TRY_AGAIN;
+                }
+                return length;
+            });
+        if (binary) {
+            response->addHeader("Content-Disposition", String("attachment; filename=") + source.name + ".bin");
+        }
+        request->send(response);
+    }
+
+    static size_t write_header(uint8_t *buffer, size_t maxLen, const HistoryFrameHeader &header) {
+        if (maxLen < HISTORY_FRAME_HEADER_SIZE) {
+            return 0;
+        }
+        history_frame_write_header(buffer, header);
+        return HISTORY_FRAME_HEADER_SIZE;
+    }
+
+    static size_t write_csv_header(uint8_t *buffer, size_t maxLen, const SampleHistory *history) {
+        int length = snprintf((char *) buffer, maxLen, "time_ms,%s\n", history->columns);
+        return length < 0 || (size_t) length >= maxLen ? 0 : length;
+    }
+
+    // Write a sample, returning its length, 0 if it's been overwritten or -1 if it doesn't fit
+    static int write_binary(uint8_t *buffer, size_t maxLen, const SampleHistory *history, uint32_t index) {
+        uint16_t size = history_frame_sample_size(history->channels);
+        if (maxLen < size) {
+            return -1;
+        }
+        return history->write_sample(index, buffer) ? size : 0;
+    }
+
+    static int write_csv(uint8_t *buffer, size_t maxLen, const SampleHistory *history, uint32_t index) {
+        uint32_t time;
+        int16_t sample[SAMPLE_HISTORY_MAX_CHANNELS];
+        if (!history->read(index, time, sample)) {
+            return 0;
+        }
+        // Print enough decimals for the divisor, e.g. 2 for hundredths
+        uint8_t decimals = 0;
+        for (uint32_t unit = 1; unit < history->divisor; unit *= 10) {
+            decimals++;
+        }
+        char row[16 + SAMPLE_HISTORY_MAX_CHANNELS * 12];
+        int length = snprintf(row, sizeof(row), "%u", (unsigned) time);
+        for (uint8_t i = 0; i < history->channels; i++) {
+            length += snprintf(row + length, sizeof(row) - length, ",%.*f", decimals, (float) sample[i] / history->divisor);
+        }
+        row[length++] = '\n';
+        if ((size_t) length > maxLen) {
+            return -1;
+        }
+        memcpy(buffer, row, length);
+        return length;
+    }
+};
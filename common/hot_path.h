@@ -0,0 +1,17 @@
+#pragma once
+
+/*
+ * Code in flash runs through the instruction cache on the ESP8266 and ESP32, and can stall on a
+ * cache miss, e.g. while Wi-Fi is busy. The functions each measurement goes through are marked
+ * HOT_PATH, and building with `-DCUSTOM_COMPONENTS_HOT_IRAM` puts them in IRAM instead.
+ *
+ * IRAM is small (especially on the ESP8266) so this is off by default. Building with
+ * `-DCUSTOM_COMPONENTS_LOOP_TIMING` makes the sensor components log the worst and p99.9 time
+ * their loop() takes in each step at every update (see loop_timing.h), so the worst case can be
+ * compared with and without it.
+ */
+#ifdef CUSTOM_COMPONENTS_HOT_IRAM
+#define HOT_PATH IRAM_ATTR
+#else
+#define HOT_PATH
+#endif
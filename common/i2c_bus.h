@@ -0,0 +1,93 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "hot_path.h"
+
+// The result of a bus transaction
+enum class I2CStatus : uint8_t {
+    OK,
+    NACK, // The device didn't acknowledge its address or the data
+    SHORT, // The device sent fewer bytes than asked for
+    ERROR // The bus itself failed, e.g. the adapter couldn't be opened
+};
+
+// Counters kept by each bus, so backends can be compared
+struct I2CBusStats {
+    uint32_t transactions = 0; // The number of writes, reads and write-reads
+    uint32_t failures = 0; // The number which didn't return OK
+    uint32_t lastMicros = 0; // The time the last one took in us
+    uint32_t worstMicros = 0; // The longest one took in us
+    uint64_t totalMicros = 0; // The time taken by all of them in us
+};
+
+/*
+ * An I2C bus the drivers talk to their sensors through, so the protocol code doesn't depend on how
+ * the bus is driven: Arduino's Wire (wire_bus.h), ESPHome's i2c component (esphome_i2c_bus.h), the
+ * ESP-IDF master driver (idf_i2c_bus.h), a multiplexer channel on any of those (tca9548a_bus.h),
+ * Linux i2c-dev (host/linux_i2c_bus.h) or a simulation (host/simulated_i2c_bus.h).
+ *
+ * Backends implement the do_ functions, and the public ones time each transaction and count it in
+ * `stats`. write_read() is a write followed by a read, which is how registers are read; backends
+ * which can use a repeated start between them override it, the default stops in between, which the
+ * sensors in this repository accept.
+ *
+ * wait() is how long a device needs to do something (e.g. a blocking library waiting for a
+ * measurement). It's on the bus so a simulation can skip the time and run the protocol at full
+ * speed.
+ */
+class I2CBus {
+    public:
+    I2CBusStats stats;
+
+    virtual ~I2CBus() {}
+
+    HOT_PATH I2CStatus write(uint8_t address, const uint8_t *data, size_t length) {
+        uint32_t start = micros();
+        return count(do_write(address, data, length), start);
+    }
+    HOT_PATH I2CStatus read(uint8_t address, uint8_t *data, size_t length) {
+        uint32_t start = micros();
+        return count(do_read(address, data, length), start);
+    }
+    HOT_PATH I2CStatus write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) {
+        uint32_t start = micros();
+        return count(do_write_read(address, data, length, buffer, size), start);
+    }
+    virtual void wait(uint32_t ms) = 0;
+    // The time in us, which the transactions are timed by
+    virtual uint32_t micros() = 0;
+
+    // Write a register, optionally followed by a value (if it's not -1)
+    HOT_PATH I2CStatus write_register(uint8_t address, uint8_t reg, int16_t value = -1) {
+        uint8_t data[2] = {reg, (uint8_t) value};
+        return write(address, data, value < 0 ? 1 : 2);
+    }
+    // Read `size` bytes starting at a register
+    HOT_PATH I2CStatus read_register(uint8_t address, uint8_t reg, uint8_t *buffer, size_t size) {
+        return write_read(address, &reg, 1, buffer, size);
+    }
+    // Check a device acknowledges its address
+    bool probe(uint8_t address) { return write(address, nullptr, 0) == I2CStatus::OK; }
+
+    protected:
+    virtual I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) = 0;
+    virtual I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) = 0;
+    virtual I2CStatus do_write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) {
+        I2CStatus status = do_write(address, data, length);
+        return status == I2CStatus::OK ? do_read(address, buffer, size) : status;
+    }
+
+    HOT_PATH I2CStatus count(I2CStatus status, uint32_t start) {
+        uint32_t elapsed = micros() - start;
+        stats.transactions++;
+        if (status != I2CStatus::OK) {
+            stats.failures++;
+        }
+        stats.lastMicros = elapsed;
+        if (elapsed > stats.worstMicros) {
+            stats.worstMicros = elapsed;
+        }
+        stats.totalMicros += elapsed;
+        return status;
+    }
+};
@@ -0,0 +1,192 @@
+#pragma once
+#include "esphome.h"
+#include "hot_path.h"
+
+// The maximum number of devices a single scheduler can arbitrate between
+#ifndef I2C_SCHEDULER_MAX_DEVICES
+#define I2C_SCHEDULER_MAX_DEVICES 16
+#endif
+
+/*
+ * Arbitrates an I2C bus shared by several of the sensor components in this repository so that
+ * time-critical devices (e.g. a SEN0590 used for presence) aren't held up by slow ones (e.g. a
+ * Tinovi leaf sensor).
+ *
+ * Each device is registered with a priority and a deadline. When a component wants to use the bus
+ * it calls acquire(); the transaction is due from the first call and must be finished within the
+ * deadline. The bus is given to the pending transaction with the highest priority, and between
+ * transactions of the same priority to the one with the earliest deadline (EDF). Only
+ * `transactionsPerLoop` transactions are started per pass of the main loop, so a device that
+ * loses the bus waits for at most the transactions ahead of it rather than a whole loop's worth.
+ * release() is called when the transaction is complete, and if it's later than the deadline it
+ * is counted as a miss.
+ *
+ * Background work, like checking a sensor is still connected, uses acquire_idle() instead, which
+ * only gets the bus when no transaction is waiting for it and doesn't count towards the deadlines.
+ *
+ * Every update interval the scheduler logs the number of transactions and deadline misses for each
+ * device if there have been any misses since the last report.
+ *
+ * Add the include under `esphome:` before the components
+ *
+ * ```
+ * includes:
+ *   - custom_components/common/i2c_scheduler.h
+ * ```
+ *
+ * and give the components the scheduler in their lambda:
+ *
+ * ```
+ * sensor:
+ *   - platform: custom
+ *     lambda: |-
+ *       static I2CScheduler bus(60000);
+ *       static Sen0590 level(1000);
+ *       static LeafWetness leaf(5000);
+ *       App.register_component(&bus);
+ *       App.register_component(&level);
+ *       App.register_component(&leaf);
+ *       level.set_scheduler(&bus, 10, 20); // high priority, 20ms deadline
+ *       leaf.set_scheduler(&bus, 1, 500); // low priority, 500ms deadline
+ *       return {&level, &leaf.temperature_sensor, &leaf.wetness_sensor};
+ * ```
+ *
+ * Only the components given the scheduler are arbitrated, anything else using the bus isn't.
+ */
+class I2CScheduler : public PollingComponent {
+    public:
+    I2CScheduler(int reportInterval) : PollingComponent(reportInterval) {}
+
+    // Register a device, returning the id to use with acquire() and release(), or -1 if full
+    int8_t add(const char *name, uint8_t priority, uint32_t deadline) {
+        if (count >= I2C_SCHEDULER_MAX_DEVICES) {
+            ESP_LOGE("i2c_scheduler", "Can't add %s, the scheduler is full", name);
+            return -1;
+        }
+        Device &device = devices[count];
+        device.name = name;
+        device.priority = priority;
+        device.deadline = deadline;
+        return count++;
+    }
+
+    // Ask for the bus, returns true if the transaction can start now
+    HOT_PATH bool acquire(int8_t id) {
+        Device &device = devices[id];
+        uint32_t now = millis();
+        if (!device.pending) {
+            device.pending = true;
+            device.due = now + device.deadline;
+        }
+        if (owner >= 0 || started >= transactionsPerLoop) {
+            return false;
+        }
+        if (next() != id) {
+            return false;
+        }
+        owner = id;
+        started++;
+        return true;
+    }
+
+    // Ask for the bus for background work, returns true if nothing else is waiting for it
+    bool acquire_idle(int8_t id) {
+        if (owner >= 0 || started >= transactionsPerLoop || next() >= 0) {
+            return false;
+        }
+        owner = id;
+        started++;
+        return true;
+    }
+
+    // The transaction is finished, so free the bus for the next one
+    HOT_PATH void release(int8_t id) {
+        Device &device = devices[id];
+        if (device.pending) {
+            int32_t lateness = (int32_t) (millis() - device.due);
+            device.transactions++;
+            if (lateness > 0) {
+                device.misses++;
+                if ((uint32_t) lateness > device.worstLateness) {
+                    device.worstLateness = lateness;
+                }
+            }
+            device.pending = false;
+        }
+        if (owner == id) {
+            owner = -1;
+        }
+    }
+
+    // The number of transactions to start per pass of the main loop
+    void set_transactions_per_loop(uint8_t transactions) { transactionsPerLoop = transactions; }
+
+    float get_setup_priority() const override { return esphome::setup_priority::BUS; }
+
+    void dump_config() override {
+        ESP_LOGCONFIG("i2c_scheduler", "I2C Scheduler:");
+        ESP_LOGCONFIG("i2c_scheduler", "  Transactions per loop: %u", (unsigned) transactionsPerLoop);
+        for (uint8_t i = 0; i < count; i++) {
+            ESP_LOGCONFIG("i2c_scheduler", "  %s: priority %u, deadline %u ms", devices[i].name,
+                          (unsigned) devices[i].priority, (unsigned) devices[i].deadline);
+        }
+    }
+
+    void loop() override {
+        // A new pass of the main loop
+        started = 0;
+    }
+
+    void update() override {
+        // Report the deadline misses
+        bool missed = false;
+        for (uint8_t i = 0; i < count; i++) {
+            missed |= devices[i].misses != devices[i].reportedMisses;
+        }
+        if (!missed) {
+            return;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            Device &device = devices[i];
+            ESP_LOGW("i2c_scheduler", "%s: %u transactions, %u deadline misses, worst %u ms late",
+                     device.name, (unsigned) device.transactions, (unsigned) device.misses,
+                     (unsigned) device.worstLateness);
+            device.reportedMisses = device.misses;
+        }
+    }
+
+    protected:
+    struct Device {
+        const char *name;
+        uint8_t priority; // Higher priorities get the bus first
+        bool pending = false; // There is a transaction waiting for, or using, the bus
+        uint32_t deadline; // The time in ms a transaction has to complete in
+        uint32_t due = 0; // The time the pending transaction must be complete by
+        uint32_t transactions = 0; // The number of completed transactions
+        uint32_t misses = 0; // The number of transactions which completed after their deadline
+        uint32_t reportedMisses = 0; // The number of misses at the last report
+        uint32_t worstLateness = 0; // The longest a transaction has been late by in ms
+    };
+
+    // The pending device which should have the bus next
+    HOT_PATH int8_t next() const {
+        int8_t best = -1;
+        for (uint8_t i = 0; i < count; i++) {
+            const Device &device = devices[i];
+            if (!device.pending) {
+                continue;
+            }
+            if (best < 0 || device.priority > devices[best].priority ||
+                (device.priority == devices[best].priority && (int32_t) (device.due - devices[best].due) < 0)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    Device devices[I2C_SCHEDULER_MAX_DEVICES];
+    uint8_t count = 0; // The number of devices registered
+    int8_t owner = -1; // The device using the bus
+    uint8_t started = 0; // The number of transactions started in this pass of the main loop
+    uint8_t transactionsPerLoop = 1;
+};
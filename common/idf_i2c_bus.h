@@ -0,0 +1,115 @@
+#pragma once
+#include "driver/i2c_master.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "i2c_bus.h"
+
+// The most devices an IdfI2CBus can talk to
+#ifndef IDF_I2C_BUS_MAX_DEVICES
+#define IDF_I2C_BUS_MAX_DEVICES 8
+#endif
+// How long a transaction can take before it's abandoned in ms
+#ifndef IDF_I2C_BUS_TIMEOUT
+#define IDF_I2C_BUS_TIMEOUT 20
+#endif
+
+/*
+ * An I2CBus on the ESP-IDF (5.2 or later) I2C master driver, for firmware built without Arduino:
+ *
+ * ```
+ * i2c_master_bus_config_t config = {};
+ * config.i2c_port = I2C_NUM_0;
+ * config.sda_io_num = GPIO_NUM_32;
+ * config.scl_io_num = GPIO_NUM_33;
+ * config.clk_source = I2C_CLK_SRC_DEFAULT;
+ * config.glitch_ignore_cnt = 7;
+ * config.flags.enable_internal_pullup = true;
+ * i2c_master_bus_handle_t handle;
+ * i2c_new_master_bus(&config, &handle);
+ * static IdfI2CBus bus(handle);
+ * ```
+ *
+ * The driver addresses devices through handles, which are added the first time each address is
+ * used and kept in a fixed table. Transactions give up after IDF_I2C_BUS_TIMEOUT ms, so a stuck
+ * bus can't hold up the loop for long. They're synchronous: the components' protothreads already
+ * wait for measurements without blocking, and each transaction is only a few bytes.
+ */
+class IdfI2CBus : public I2CBus {
+    public:
+    IdfI2CBus(i2c_master_bus_handle_t bus, uint32_t frequency = 100000) : bus(bus), frequency(frequency) {}
+
+    void wait(uint32_t ms) override { vTaskDelay(pdMS_TO_TICKS(ms)); }
+    uint32_t micros() override { return (uint32_t) esp_timer_get_time(); }
+
+    protected:
+    struct Device {
+        uint8_t address;
+        i2c_master_dev_handle_t handle;
+    };
+
+    i2c_master_bus_handle_t bus;
+    uint32_t frequency;
+    Device devices[IDF_I2C_BUS_MAX_DEVICES];
+    uint8_t count = 0; // The number of devices added
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        if (length == 0) {
+            // The driver can't send an empty write, but has a probe for the same thing
+            return status(i2c_master_probe(bus, address, IDF_I2C_BUS_TIMEOUT));
+        }
+        i2c_master_dev_handle_t device = handle(address);
+        if (device == nullptr) {
+            return I2CStatus::ERROR;
+        }
+        return status(i2c_master_transmit(device, data, length, IDF_I2C_BUS_TIMEOUT));
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        i2c_master_dev_handle_t device = handle(address);
+        if (device == nullptr) {
+            return I2CStatus::ERROR;
+        }
+        return status(i2c_master_receive(device, data, length, IDF_I2C_BUS_TIMEOUT));
+    }
+    I2CStatus do_write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) override {
+        i2c_master_dev_handle_t device = handle(address);
+        if (device == nullptr) {
+            return I2CStatus::ERROR;
+        }
+        return status(i2c_master_transmit_receive(device, data, length, buffer, size, IDF_I2C_BUS_TIMEOUT));
+    }
+
+    // The driver's handle for an address, adding it if it's new
+    i2c_master_dev_handle_t handle(uint8_t address) {
+        for (uint8_t i = 0; i < count; i++) {
+            if (devices[i].address == address) {
+                return devices[i].handle;
+            }
+        }
+        if (count >= IDF_I2C_BUS_MAX_DEVICES) {
+            return nullptr;
+        }
+        i2c_device_config_t config = {};
+        config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+        config.device_address = address;
+        config.scl_speed_hz = frequency;
+        if (i2c_master_bus_add_device(bus, &config, &devices[count].handle) != ESP_OK) {
+            return nullptr;
+        }
+        devices[count].address = address;
+        return devices[count++].handle;
+    }
+
+    static I2CStatus status(esp_err_t error) {
+        switch (error) {
+            case ESP_OK:
+                return I2CStatus::OK;
+            case ESP_ERR_NOT_FOUND: // From a probe
+            case ESP_ERR_INVALID_STATE: // NACK during a transaction
+            case ESP_ERR_INVALID_RESPONSE:
+                return I2CStatus::NACK;
+            default:
+                return I2CStatus::ERROR;
+        }
+    }
+};
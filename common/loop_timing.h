@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+// The number of histogram buckets, bucket n counts times under 2^n us so the last is over 16ms
+#define LOOP_TIMING_BUCKETS 16
+
+/*
+ * Execution time statistics for one step of a driver's loop(), kept when building with
+ * `-DCUSTOM_COMPONENTS_LOOP_TIMING`. The worst case is exact, and a power of two histogram gives
+ * an upper bound on the percentiles (e.g. p99.9) without storing the samples.
+ *
+ * To see the worst case the steps need to be exercised under bad conditions while it's running,
+ * e.g. unplugging the sensor so the bus times out, or with heavy Wi-Fi traffic. host/wcet_harness.cpp
+ * does this on the host, injecting faults on a simulated bus, and checks these statistics against
+ * the exact ones.
+ */
+struct LoopTiming {
+    uint32_t count = 0; // The number of times the step has run
+    uint32_t worst = 0; // The longest the step has taken in us
+    uint32_t buckets[LOOP_TIMING_BUCKETS] = {0};
+
+    void add(uint32_t elapsed) {
+        count++;
+        if (elapsed > worst) {
+            worst = elapsed;
+        }
+        uint8_t bucket = elapsed == 0 ? 0 : 32 - __builtin_clz(elapsed);
+        buckets[bucket < LOOP_TIMING_BUCKETS ? bucket : LOOP_TIMING_BUCKETS - 1]++;
+    }
+
+    // An upper bound in us on the time `permille` thousandths of the runs took less than
+    uint32_t percentile(uint32_t permille) const {
+        uint64_t target = ((uint64_t) count * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (uint8_t i = 0; i < LOOP_TIMING_BUCKETS - 1; i++) {
+            seen += buckets[i];
+            if (seen >= target) {
+                uint32_t bound = 1UL << i;
+                return bound < worst ? bound : worst;
+            }
+        }
+        return worst;
+    }
+};
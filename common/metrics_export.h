@@ -0,0 +1,185 @@
+#pragma once
+#include "esphome.h"
+#include "esphome/components/web_server_base/web_server_base.h"
+#include "sensor_metrics.h"
+
+// The maximum number of sensors that can be exported
+#ifndef METRICS_EXPORT_MAX_SOURCES
+#define METRICS_EXPORT_MAX_SOURCES 16
+#endif
+// The longest name a sensor can be given
+#define METRICS_EXPORT_NAME_LENGTH 32
+
+/*
+ * Serves the counters of the sensor components (see sensor_metrics.h) at `/metrics` on ESPHome's
+ * web server in the Prometheus text format, so a fleet of nodes can be scraped directly rather than
+ * through Home Assistant:
+ *
+ * - `custom_sensor_samples_total` - measurements published
+ * - `custom_sensor_errors_total` - measurements, probes and self-tests which failed
+ * - `custom_sensor_online` - whether the sensor has passed its self-test
+ * - `custom_sensor_bus_seconds_total` - time holding the bus, its rate is the bus utilisation
+ * - `custom_sensor_latency_ms` - a histogram of the time from starting a measurement to publishing it
+ *
+ * Each is labelled with the name given to add(), the driver and the address. The response is
+ * written a line at a time straight from the counters as the web server asks for it, so nothing is
+ * allocated to build it. Like history_export.h it needs the `web_server:` component and the Arduino
+ * framework, and the components built with `-DCUSTOM_COMPONENTS_METRICS`. Add the includes under
+ * `esphome:`
+ *
+ * ```
+ * includes:
+ *   - custom_components/common/sensor_metrics.h
+ *   - custom_components/common/metrics_export.h
+ * ```
+ *
+ * and add the components in the lambda:
+ *
+ * ```
+ * static MetricsExport metrics;
+ * App.register_component(&metrics);
+ * metrics.add("tank", &level);
+ * metrics.add("leaf_61", &leaf);
+ * ```
+ */
+class MetricsExport : public Component, public AsyncWebHandler {
+    public:
+    // Export the metrics of a sensor component, the name needs to stay valid
+    template<typename Driver>
+    bool add(const char *name, const Driver *component) {
+        if (count >= METRICS_EXPORT_MAX_SOURCES || strlen(name) > METRICS_EXPORT_NAME_LENGTH) {
+            ESP_LOGE("metrics_export", "Can't add %s", name);
+            return false;
+        }
+        sources[count].name = name;
+        sources[count].driver = Driver::tag;
+        sources[count].address = component->address;
+        sources[count].online = &component->online;
+        sources[count].metrics = &component->metrics;
+        count++;
+        return true;
+    }
+
+    float get_setup_priority() const override { return esphome::setup_priority::AFTER_WIFI; }
+
+    void setup() override {
+        web_server_base::global_web_server_base->add_handler(this);
+    }
+
+    void dump_config() override {
+        ESP_LOGCONFIG("metrics_export", "Metrics Export:");
+        ESP_LOGCONFIG("metrics_export", "  Sensors: %u", (unsigned) count);
+    }
+
+    bool canHandle(AsyncWebServerRequest *request) override {
+        return request->method() == HTTP_GET && request->url() == "/metrics";
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override {
+        uint8_t family = 0;
+        uint16_t position = 0;
+        request->send(request->beginChunkedResponse("text/plain; version=0.0.4",
+            [this, family, position](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+                size_t length = 0;
+                while (family < FAMILIES) {
+                    char line[192];
+                    int written = render(family, position, line, sizeof(line));
+                    if (written < 0) {
+                        // The end of this metric
+                        family++;
+                        position = 0;
+                        continue;
+                    }
+                    if ((size_t) written > maxLen - length) {
+                        break;
+                    }
+                    memcpy(buffer + length, line, written);
+                    length += written;
+                    position++;
+                }
+                // Returning 0 would end the response
+                return length == 0 && family < FAMILIES ? RESPONSE_TRY_AGAIN : length;
+            }));
+    }
+
+    protected:
+    struct Source {
+        const char *name;
+        const char *driver;
+        uint8_t address;
+        const bool *online;
+        const SensorMetrics *metrics;
+    };
+
+    struct Family {
+        const char *name;
+        const char *type;
+        const char *help;
+        uint8_t rows; // The number of lines for each sensor
+    };
+
+    enum : uint8_t { SAMPLES, ERRORS, ONLINE, BUS, LATENCY, FAMILIES };
+
+    Source sources[METRICS_EXPORT_MAX_SOURCES];
+    uint8_t count = 0; // The number of sensors added
+
+    // Render a line of a metric into `line`, returning its length or -1 after the last line. The
+    // first two lines are the help and type, then the lines for each sensor.
+    int render(uint8_t family, uint16_t position, char *line, size_t size) const {
+        static const Family families[FAMILIES] = {
+            {"custom_sensor_samples_total", "counter", "Measurements published", 1},
+            {"custom_sensor_errors_total", "counter", "Measurements, probes and self-tests which failed", 1},
+            {"custom_sensor_online", "gauge", "Whether the sensor has passed its self-test", 1},
+            {"custom_sensor_bus_seconds_total", "counter", "Time holding the I2C bus", 1},
+            // A bucket for each power of two, the last is +Inf, then the sum and the count
+            {"custom_sensor_latency_ms", "histogram", "Time from starting a measurement to publishing it",
+             LOOP_TIMING_BUCKETS + 2},
+        };
+        const Family &metric = families[family];
+        if (position == 0) {
+            return snprintf(line, size, "# HELP %s %s\n", metric.name, metric.help);
+        }
+        if (position == 1) {
+            return snprintf(line, size, "# TYPE %s %s\n", metric.name, metric.type);
+        }
+        uint16_t index = (position - 2) / metric.rows;
+        uint8_t row = (position - 2) % metric.rows;
+        if (index >= count) {
+            return -1;
+        }
+        const Source &source = sources[index];
+        const SensorMetrics &metrics = *source.metrics;
+        char labels[96];
+        snprintf(labels, sizeof(labels), "sensor=\"%s\",driver=\"%s\",address=\"0x%02X\"", source.name,
+                 source.driver, source.address);
+        switch (family) {
+            case SAMPLES:
+                return snprintf(line, size, "%s{%s} %u\n", metric.name, labels, (unsigned) metrics.samples);
+            case ERRORS:
+                return snprintf(line, size, "%s{%s} %u\n", metric.name, labels, (unsigned) metrics.errors);
+            case ONLINE:
+                return snprintf(line, size, "%s{%s} %u\n", metric.name, labels, *source.online ? 1 : 0);
+            case BUS:
+                return snprintf(line, size, "%s{%s} %.6f\n", metric.name, labels, metrics.busMicros / 1e6);
+            default:
+                break;
+        }
+        const LoopTiming &latency = metrics.latency;
+        if (row == LOOP_TIMING_BUCKETS) {
+            return snprintf(line, size, "%s_sum{%s} %.0f\n", metric.name, labels, (double) metrics.latencySum);
+        }
+        if (row == LOOP_TIMING_BUCKETS + 1) {
+            return snprintf(line, size, "%s_count{%s} %u\n", metric.name, labels, (unsigned) latency.count);
+        }
+        if (row == LOOP_TIMING_BUCKETS - 1) {
+            return snprintf(line, size, "%s_bucket{%s,le=\"+Inf\"} %u\n", metric.name, labels, (unsigned) latency.count);
+        }
+        // Bucket n counts latencies under 2^n ms, and they're whole ms
+        uint32_t cumulative = 0;
+        for (uint8_t i = 0; i <= row; i++) {
+            cumulative += latency.buckets[i];
+        }
+        return snprintf(line, size, "%s_bucket{%s,le=\"%u\"} %u\n", metric.name, labels,
+                        (unsigned) ((1UL << row) - 1), (unsigned) cumulative);
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Stackless protothreads, so that a driver's loop() can be written as a straight sequence of steps
+ * which wait for things (the bus, a timeout) instead of a hand-written switch statement. They are
+ * the older-toolchain equivalent of C++20 coroutines: the thread only stores the line it's waiting
+ * on, and each wait returns from loop() so nothing blocks.
+ *
+ * ```
+ * void loop() override {
+ *     PT_BEGIN(thread);
+ *     PT_WAIT_UNTIL(thread, acquire_bus());
+ *     ... start a measurement ...
+ *     PT_WAIT_MS(thread, 50);
+ *     ... read it ...
+ *     PT_END(thread);
+ * }
+ * ```
+ *
+ * Dispatching costs the same as the switch statement it replaces: host/protothread_bench.cpp drives
+ * the same SEN0590 steps both ways on a simulated bus. The state is bigger though: a Protothread is
+ * 8 bytes (the 16-bit line, padding and the 32-bit timer) where the switch kept a 4-byte timer
+ * alongside its state, so the drivers grew by 4 bytes each when they moved to protothreads.
+ *
+ * Because the function returns at every wait, local variables don't keep their values across
+ * waits (keep them in members), a switch statement can't be used between PT_BEGIN and PT_END, and
+ * there can only be one wait per line as the line number identifies it.
+ */
+struct Protothread {
+    uint16_t line = 0; // The line the thread is waiting on, 0 if it's at the start
+    uint32_t timer = 0; // The time PT_WAIT_MS started waiting
+};
+
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define PT_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define PT_FALLTHROUGH
+#endif
+
+// Start the thread, resuming from where it last waited
+#define PT_BEGIN(pt) switch ((pt).line) { case 0:
+
+// Return from loop() until the condition is true, then carry on from here
+#define PT_WAIT_UNTIL(pt, condition) \
+    do { \
+        (pt).line = __LINE__; \
+        PT_FALLTHROUGH; \
+        case __LINE__: \
+        if (!(condition)) { \
+            return; \
+        } \
+    } while (0)
+
+// Return from loop() and carry on from here on the next call
+#define PT_YIELD(pt) \
+    do { \
+        (pt).line = __LINE__; \
+        return; \
+        case __LINE__:; \
+    } while (0)
+
+// Wait for a number of milliseconds without blocking
+#define PT_WAIT_MS(pt, ms) \
+    do { \
+        (pt).timer = millis(); \
+        PT_WAIT_UNTIL(pt, millis() - (pt).timer >= (uint32_t) (ms)); \
+    } while (0)
+
+// Go back to the start of the thread
+#define PT_RESTART(pt) \
+    do { \
+        (pt).line = 0; \
+        return; \
+    } while (0)
+
+// The end of the thread, which goes back to the start
+#define PT_END(pt) } (pt).line = 0
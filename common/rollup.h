@@ -0,0 +1,160 @@
+#pragma once
+#include <stdint.h>
+
+// The levels statistics are rolled up to
+enum RollupLevel : uint8_t {
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    ROLLUP_DAY,
+    ROLLUP_LEVELS
+};
+
+// The min, max and mean of the samples in a period
+struct RollupBucket {
+    int32_t min = INT32_MAX;
+    int32_t max = INT32_MIN;
+    int64_t sum = 0;
+    uint32_t count = 0;
+
+    void add(int32_t value) {
+        if (value < min) {
+            min = value;
+        }
+        if (value > max) {
+            max = value;
+        }
+        sum += value;
+        count++;
+    }
+    void add(const RollupBucket &bucket) {
+        if (bucket.min < min) {
+            min = bucket.min;
+        }
+        if (bucket.max > max) {
+            max = bucket.max;
+        }
+        sum += bucket.sum;
+        count += bucket.count;
+    }
+    int32_t mean() const { return count == 0 ? 0 : (int32_t) (sum / (int64_t) count); }
+};
+
+/*
+ * Minute, hour and day statistics (min, max, mean) of a sensor's readings kept on the device, so
+ * dashboards don't need to query the recorder for them. Each sample only updates the current
+ * minute; when a minute ends it's added to the current hour, and each hour to the current day, so
+ * the work per sample is constant. A gap with no samples is closed when the next sample arrives,
+ * in a few steps however long it was: the rest of the hour and day it started in, then the whole
+ * empty hours and days after them at once. The storage is fixed: the bucket being filled and the
+ * last completed bucket for each level.
+ *
+ * A sample can end several periods at once, e.g. after a gap, or when it's sampled less often than
+ * once a minute, and by then `last` holds the last of them, which is empty. So rather than reading
+ * `last`, pass add() a function to be called with each period that had samples as it completes:
+ *
+ * ```
+ * rollup.add(value, millis(), [&](uint8_t level, const RollupBucket &bucket) { ... });
+ * ```
+ *
+ * The periods are measured from when the first sample is added using the time passed in (e.g.
+ * millis()), so they're aligned to the uptime rather than the clock. It doesn't depend on ESPHome
+ * so the same statistics can be computed on the host.
+ */
+class Rollup {
+    public:
+    RollupBucket current[ROLLUP_LEVELS]; // The buckets being filled
+    RollupBucket last[ROLLUP_LEVELS]; // The last completed bucket of each level
+
+    // Add a sample taken at `now` ms, calling `completed(level, bucket)` for each period with samples
+    // which ended before it, and returning a bit (1 << level) for each level which completed
+    template<typename Completed>
+    uint8_t add(int32_t value, uint32_t now, Completed completed) {
+        uint8_t levels = advance(now, completed);
+        current[ROLLUP_MINUTE].add(value);
+        return levels;
+    }
+    uint8_t add(int32_t value, uint32_t now) { return add(value, now, ignore); }
+
+    // Close any minutes which have ended by `now`, returning the levels which completed
+    template<typename Completed>
+    uint8_t advance(uint32_t now, Completed completed) {
+        if (!started) {
+            started = true;
+            minuteStart = now;
+        }
+        uint32_t elapsed = (now - minuteStart) / 60000UL; // The minutes which have ended
+        if (elapsed == 0) {
+            return 0;
+        }
+        minuteStart += elapsed * 60000UL;
+        uint8_t levels = close(ROLLUP_MINUTE, completed);
+        return elapsed > 1 ? levels | skip(elapsed - 1, completed) : levels;
+    }
+    uint8_t advance(uint32_t now) { return advance(now, ignore); }
+
+    protected:
+    bool started = false;
+    uint8_t minutes = 0; // The number of minutes in the current hour
+    uint8_t hours = 0; // The number of hours in the current day
+    uint32_t minuteStart = 0; // When the current minute started
+
+    static void ignore(uint8_t, const RollupBucket &) {}
+
+    // Close `count` empty minutes after the current one, as closing them one at a time would
+    template<typename Completed>
+    uint8_t skip(uint32_t count, Completed &completed) {
+        uint8_t levels = 1 << ROLLUP_MINUTE;
+        last[ROLLUP_MINUTE] = RollupBucket();
+        // The rest of the current hour, which may have samples
+        if (count < 60u - minutes) {
+            minutes += count;
+            return levels;
+        }
+        count -= 60u - minutes;
+        minutes = count % 60;
+        levels |= close(ROLLUP_HOUR, completed);
+        // Whole empty hours, then the rest of the current day
+        uint32_t emptyHours = count / 60;
+        if (emptyHours == 0) {
+            return levels;
+        }
+        levels |= 1 << ROLLUP_HOUR;
+        last[ROLLUP_HOUR] = RollupBucket();
+        if (emptyHours < 24u - hours) {
+            hours += emptyHours;
+            return levels;
+        }
+        emptyHours -= 24u - hours;
+        hours = emptyHours % 24;
+        levels |= close(ROLLUP_DAY, completed);
+        // Whole empty days
+        if (emptyHours >= 24) {
+            last[ROLLUP_DAY] = RollupBucket();
+        }
+        return levels;
+    }
+
+    template<typename Completed>
+    uint8_t close(uint8_t level, Completed &completed) {
+        uint8_t levels = 1 << level;
+        last[level] = current[level];
+        current[level] = RollupBucket();
+        if (last[level].count > 0) {
+            completed(level, last[level]);
+        }
+        if (level == ROLLUP_MINUTE) {
+            current[ROLLUP_HOUR].add(last[level]);
+            if (++minutes == 60) {
+                minutes = 0;
+                levels |= close(ROLLUP_HOUR, completed);
+            }
+        } else if (level == ROLLUP_HOUR) {
+            current[ROLLUP_DAY].add(last[level]);
+            if (++hours == 24) {
+                hours = 0;
+                levels |= close(ROLLUP_DAY, completed);
+            }
+        }
+        return levels;
+    }
+};
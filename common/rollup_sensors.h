@@ -0,0 +1,49 @@
+#pragma once
+#include "esphome.h"
+#include "rollup.h"
+#include "hot_path.h"
+
+// The statistics of a rollup which can be published
+enum RollupStatistic : uint8_t {
+    ROLLUP_MIN,
+    ROLLUP_MAX,
+    ROLLUP_MEAN,
+    ROLLUP_STATISTICS
+};
+
+/*
+ * Publishes the statistics of a Rollup on ESPHome sensors each time a period with samples
+ * completes, including each one a sample ends at once (e.g. every minute when it's sampled less
+ * often). Only the statistics given a sensor are published, e.g. to publish the daily maximum:
+ *
+ * ```
+ * static Sensor dailyMax;
+ * sensor.temperatureRollup.set_sensor(ROLLUP_DAY, ROLLUP_MAX, &dailyMax);
+ * return {..., &dailyMax};
+ * ```
+ */
+class RollupSensors : public Rollup {
+    public:
+    // Publish a statistic for a level on a sensor
+    void set_sensor(RollupLevel level, RollupStatistic statistic, Sensor *sensor) {
+        sensors[level][statistic] = sensor;
+    }
+
+    // Add a sample (in the units of the sensor / `divisor`) and publish any completed periods
+    HOT_PATH void add(int32_t value, uint32_t now, float divisor) {
+        Rollup::add(value, now, [this, divisor](uint8_t level, const RollupBucket &bucket) {
+            publish(level, ROLLUP_MIN, bucket.min / divisor);
+            publish(level, ROLLUP_MAX, bucket.max / divisor);
+            publish(level, ROLLUP_MEAN, bucket.mean() / divisor);
+        });
+    }
+
+    protected:
+    Sensor *sensors[ROLLUP_LEVELS][ROLLUP_STATISTICS] = {};
+
+    void publish(uint8_t level, uint8_t statistic, float value) {
+        if (sensors[level][statistic] != nullptr) {
+            sensors[level][statistic]->publish_state(value);
+        }
+    }
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "hot_path.h"
+
+// The number of samples each history keeps
+#ifndef SAMPLE_HISTORY_CAPACITY
+#define SAMPLE_HISTORY_CAPACITY 128
+#endif
+
+// The most channels a history can have
+#define SAMPLE_HISTORY_MAX_CHANNELS 4
+
+#define HISTORY_FRAME_VERSION 2
+#define HISTORY_FRAME_NAME_LENGTH 20
+#define HISTORY_FRAME_HEADER_SIZE 36
+
+/*
+ * The binary history export is a frame: a 36 byte header followed by the samples, oldest first,
+ * until the end of the stream. Everything is little-endian.
+ *
+ * | Offset | Size | Field                                                              |
+ * |--------|------|--------------------------------------------------------------------|
+ * | 0      | 4    | "CCHF"                                                             |
+ * | 4      | 1    | HISTORY_FRAME_VERSION                                              |
+ * | 5      | 1    | The number of channels in each sample                              |
+ * | 6      | 2    | The divisor, the values are in units of 1/divisor                  |
+ * | 8      | 4    | The uptime in ms when the export started, to convert sample times  |
+ * | 12     | 4    | The boot id, a random number the node picks when it starts         |
+ * | 16     | 20   | The name of the history, padded with zeros                         |
+ *
+ * Each sample is its uptime in ms (4 bytes) followed by an int16 value for each channel. The boot
+ * id tells the samples of each boot apart, as the uptime starts again when the node restarts and
+ * wraps every 49.7 days. Version 1 frames had no boot id.
+ */
+struct HistoryFrameHeader {
+    uint8_t channels;
+    uint16_t divisor;
+    uint32_t now;
+    uint32_t boot;
+    char name[HISTORY_FRAME_NAME_LENGTH + 1];
+};
+
+// Write a little-endian value of `size` bytes, returning the position after it
+inline uint8_t *history_frame_put(uint8_t *buffer, uint32_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        *buffer++ = (uint8_t) (value >> (8 * i));
+    }
+    return buffer;
+}
+
+// Read a little-endian value of `size` bytes
+inline uint32_t history_frame_get(const uint8_t *buffer, uint8_t size) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        value |= (uint32_t) buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+// Write a frame header into HISTORY_FRAME_HEADER_SIZE bytes
+inline void history_frame_write_header(uint8_t *buffer, const HistoryFrameHeader &header) {
+    memcpy(buffer, "CCHF", 4);
+    buffer[4] = HISTORY_FRAME_VERSION;
+    buffer[5] = header.channels;
+    history_frame_put(buffer + 6, header.divisor, 2);
+    history_frame_put(buffer + 8, header.now, 4);
+    history_frame_put(buffer + 12, header.boot, 4);
+    memset(buffer + 16, 0, HISTORY_FRAME_NAME_LENGTH);
+    memcpy(buffer + 16, header.name, strnlen(header.name, HISTORY_FRAME_NAME_LENGTH));
+}
+
+// Read a frame header from HISTORY_FRAME_HEADER_SIZE bytes, false if it isn't one
+inline bool history_frame_read_header(const uint8_t *buffer, HistoryFrameHeader &header) {
+    if (memcmp(buffer, "CCHF", 4) != 0 || buffer[4] != HISTORY_FRAME_VERSION) {
+        return false;
+    }
+    header.channels = buffer[5];
+    header.divisor = history_frame_get(buffer + 6, 2);
+    header.now = history_frame_get(buffer + 8, 4);
+    header.boot = history_frame_get(buffer + 12, 4);
+    memcpy(header.name, buffer + 16, HISTORY_FRAME_NAME_LENGTH);
+    header.name[HISTORY_FRAME_NAME_LENGTH] = '\0';
+    return true;
+}
+
+// The size of a sample with `channels` values in a frame
+inline uint16_t history_frame_sample_size(uint8_t channels) { return 4 + 2 * channels; }
+
+/*
+ * The most recent samples of a sensor kept in a ring buffer in RAM, so they can be downloaded at
+ * full resolution (see history_export.h) without going through Home Assistant's recorder. Each
+ * sample is the uptime in ms and an int16 for each channel, in the units the driver works in (e.g.
+ * hundredths of a degree) so nothing is lost to rounding.
+ *
+ * Samples are numbered from 0 as they're added, and the last `capacity` of them are kept. They can
+ * be read while samples are being added (e.g. by the web server on the ESP32's other core): read()
+ * checks the sample wasn't overwritten while it was copied.
+ *
+ * The storage is given by the subclass, see StaticSampleHistory, so there's a single
+ * implementation for histories with different numbers of channels. It doesn't depend on ESPHome.
+ */
+class SampleHistory {
+    public:
+    const char *columns; // The names of the channels, comma separated
+    const uint16_t divisor; // The values are in units of 1/divisor
+    const uint8_t channels; // The number of values in each sample
+    const uint16_t capacity; // The number of samples kept
+
+    SampleHistory(const char *columns, uint16_t divisor, uint8_t channels, uint16_t capacity, uint32_t *times, int16_t *values) :
+        columns(columns), divisor(divisor), channels(channels), capacity(capacity), times(times), values(values) {}
+
+    // Limit a value to what a sample can hold
+    static int16_t clamp(int32_t value) {
+        return value < INT16_MIN ? INT16_MIN : value > INT16_MAX ? INT16_MAX : (int16_t) value;
+    }
+
+    // Add a sample taken at `time` ms with a value for each channel
+    HOT_PATH void add(uint32_t time, const int16_t *sample) {
+        uint32_t index = count;
+        uint16_t slot = index % capacity;
+        writing = index + 1;
+        times[slot] = time;
+        memcpy(values + slot * channels, sample, channels * sizeof(int16_t));
+        count = index + 1;
+    }
+
+    // The number of samples which have been added
+    uint32_t total() const { return count; }
+
+    // The number of the oldest sample kept
+    uint32_t oldest() const {
+        uint32_t total = count;
+        return total > capacity ? total - capacity : 0;
+    }
+
+    // Copy a sample, false if it's no longer (or not yet) kept
+    bool read(uint32_t index, uint32_t &time, int16_t *sample) const {
+        if (index >= count) {
+            return false;
+        }
+        uint16_t slot = index % capacity;
+        time = times[slot];
+        memcpy(sample, values + slot * channels, channels * sizeof(int16_t));
+        // The slot is reused by sample index + capacity
+        return writing <= index + capacity;
+    }
+
+    // Write a sample into history_frame_sample_size(channels) bytes, false if it's no longer kept
+    bool write_sample(uint32_t index, uint8_t *buffer) const {
+        uint32_t time;
+        int16_t sample[SAMPLE_HISTORY_MAX_CHANNELS];
+        if (!read(index, time, sample)) {
+            return false;
+        }
+        buffer = history_frame_put(buffer, time, 4);
+        for (uint8_t i = 0; i < channels; i++) {
+            buffer = history_frame_put(buffer, (uint16_t) sample[i], 2);
+        }
+        return true;
+    }
+
+    protected:
+    uint32_t *times;
+    int16_t *values;
+    volatile uint32_t count = 0; // The number of samples added, written after the sample
+    volatile uint32_t writing = 0; // The number of samples started, written before the sample
+};
+
+// A SampleHistory with its storage, so it can be a member of a driver without using the heap
+template<uint8_t Channels, uint16_t Capacity = SAMPLE_HISTORY_CAPACITY>
+class StaticSampleHistory : public SampleHistory {
+    public:
+    static_assert(Channels >= 1 && Channels <= SAMPLE_HISTORY_MAX_CHANNELS, "Too many channels");
+
+    StaticSampleHistory(const char *columns, uint16_t divisor) :
+        SampleHistory(columns, divisor, Channels, Capacity, timeStorage, valueStorage) {}
+
+    protected:
+    uint32_t timeStorage[Capacity];
+    int16_t valueStorage[Capacity * Channels];
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include "loop_timing.h"
+
+/*
+ * Operational counters of a sensor component, kept when building with
+ * `-DCUSTOM_COMPONENTS_METRICS` and served by metrics_export.h. They only ever increase (apart from
+ * a restart) so the rates can be worked out by whatever scrapes them.
+ */
+struct SensorMetrics {
+    uint32_t samples = 0; // The number of measurements published
+    uint32_t errors = 0; // The number of measurements, probes and self-tests which failed
+    uint64_t busMicros = 0; // The time the component has had the bus in us
+    uint64_t latencySum = 0; // The total of the latencies in ms
+    LoopTiming latency; // From starting a measurement to publishing it, in ms rather than us
+
+    // A measurement was published `latency` ms after it was started
+    void sample(uint32_t latency) {
+        samples++;
+        latencySum += latency;
+        this->latency.add(latency);
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include "i2c_bus.h"
+
+/*
+ * A TCA9548A (or PCA9548A) style I2C multiplexer, which connects any of its 8 channels to the bus
+ * it's on when the channel mask is written to its address. Each channel is an I2CBus
+ * (TCA9548AChannel) which selects the channel before each transaction, so sensors with the same
+ * address can be on different channels, and the components don't need to know about the
+ * multiplexer:
+ *
+ * ```
+ * static TCA9548A mux(wire_bus(), 0x70);
+ * static TCA9548AChannel channel3(&mux, 3);
+ * static LeafWetness leaf_62(5000, 0x62);
+ * leaf_62.set_bus(&channel3);
+ * ```
+ *
+ * The multiplexer remembers the channel selected, so it's only written when a transaction is on a
+ * different channel from the last one. Anything else writing to it directly (e.g. the leaf sensor
+ * provisioner) should be removed from the configuration before the channels are used. If the
+ * components share the bus through an I2CScheduler, the channel is selected within the transaction
+ * it arbitrates.
+ */
+class TCA9548A {
+    public:
+    TCA9548A(I2CBus *bus, uint8_t address = 0x70) : bus(bus), address(address) {}
+
+    I2CBus *bus; // The bus the multiplexer is on
+    uint8_t address; // The address of the multiplexer
+    int8_t selected = -1; // The channel connected, -1 if it isn't known
+
+    // Connect a channel to the bus, if it isn't already
+    I2CStatus select(uint8_t channel) {
+        if (selected == channel) {
+            return I2CStatus::OK;
+        }
+        uint8_t mask = 1 << channel;
+        I2CStatus status = bus->write(address, &mask, 1);
+        // If the write failed the multiplexer may or may not have the new channel
+        selected = status == I2CStatus::OK ? channel : -1;
+        return status;
+    }
+};
+
+// A channel of a TCA9548A, which selects it before each transaction
+class TCA9548AChannel : public I2CBus {
+    public:
+    TCA9548AChannel(TCA9548A *multiplexer, uint8_t channel) : multiplexer(multiplexer), channel(channel & 0x07) {}
+
+    void wait(uint32_t ms) override { multiplexer->bus->wait(ms); }
+    uint32_t micros() override { return multiplexer->bus->micros(); }
+
+    protected:
+    TCA9548A *multiplexer;
+    uint8_t channel;
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        I2CStatus status = multiplexer->select(channel);
+        return status == I2CStatus::OK ? multiplexer->bus->write(address, data, length) : status;
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        I2CStatus status = multiplexer->select(channel);
+        return status == I2CStatus::OK ? multiplexer->bus->read(address, data, length) : status;
+    }
+    // Keep the parent's repeated start, if it has one
+    I2CStatus do_write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) override {
+        I2CStatus status = multiplexer->select(channel);
+        return status == I2CStatus::OK ? multiplexer->bus->write_read(address, data, length, buffer, size) : status;
+    }
+};
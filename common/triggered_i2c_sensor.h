@@ -0,0 +1,385 @@
+#pragma once
+#include "esphome.h"
+#include "fixed_calibration.h"
+#include "hot_path.h"
+#include "i2c_bus.h"
+#include "i2c_scheduler.h"
+#include "loop_timing.h"
+#include "protothread.h"
+#include "sensor_metrics.h"
+#ifdef ARDUINO
+#include "wire_bus.h"
+#endif
+
+// The time to wait before retrying the self-test of a sensor which failed it, doubling after each
+// failure up to the maximum
+#ifndef TRIGGERED_SENSOR_RETRY_MIN
+#define TRIGGERED_SENSOR_RETRY_MIN 5000
+#endif
+#ifndef TRIGGERED_SENSOR_RETRY_MAX
+#define TRIGGERED_SENSOR_RETRY_MAX 300000
+#endif
+// How often to check the sensor is still there (or has come back) while the bus is idle in ms
+#ifndef TRIGGERED_SENSOR_PROBE_INTERVAL
+#define TRIGGERED_SENSOR_PROBE_INTERVAL 2000
+#endif
+// The number of measurements in a row which can fail before the sensor is taken offline
+#ifndef TRIGGERED_SENSOR_MAX_FAILURES
+#define TRIGGERED_SENSOR_MAX_FAILURES 3
+#endif
+
+// The steps a measurement goes through
+enum class TriggeredSensorState : uint8_t {
+    REQUEST, // Request a new measurement
+    WAITING, // Waiting for the measurement
+    READY, // Ready to request the measurement value, waiting for the bus
+    READ, // Reading the measurement value
+    IDLE, // There is no request in progress
+    OFFLINE // The sensor isn't there or failed its self-test, waiting to try again
+};
+#define TRIGGERED_SENSOR_STEPS 6
+
+/*
+ * A non-blocking driver for I2C sensors which start a measurement when a register is written, take
+ * a fixed time to make it, and send it back after another register is written. The SEN0590 and the
+ * Tinovi leaf sensor both work this way, so rather than each having its own state machine they are
+ * described to this class, which generates the protothread (see protothread.h) that takes the
+ * measurement and shares the bus through an I2CScheduler if one is given.
+ *
+ * The first measurement after boot is a self-test: if the sensor doesn't acknowledge its address,
+ * the read fails, or the payload isn't plausible, the sensor is taken offline. A sensor which is
+ * online is taken offline the same way if several measurements in a row fail. The component shows
+ * a warning while its sensor is offline.
+ *
+ * Sensors can be unplugged and plugged back in while running. Between measurements, whenever the bus
+ * is idle, the sensor's address is probed (an empty write) if it hasn't been seen for a couple of
+ * seconds. An offline sensor ignores update() and only probes its address until it answers, then
+ * runs the self-test again; if it answers but fails the self-test it waits 5s, backing off to 5
+ * minutes, before trying again. When a sensor comes online the driver's attached() is called to
+ * re-initialise anything the sensor needs, and when a measurement fails its measurement_failed() is
+ * called to drop anything it was part way through, e.g. an average.
+ *
+ * The sensor is talked to through an I2CBus (see i2c_bus.h), which is the Wire global unless it's
+ * given another with set_bus(), e.g. to use a bus defined by ESPHome's `i2c:` component:
+ *
+ * ```
+ * static ESPHomeI2CBus bus(id(bus_a));
+ * sensor.set_bus(&bus);
+ * ```
+ *
+ * For commissioning and calibration, building with `-DCUSTOM_COMPONENTS_RAW_CHANNELS` logs the
+ * bytes of every measurement read (e.g. `raw 61 10270807`) and lets drivers publish the
+ * undecoded values on extra sensors. Without it none of this is compiled in.
+ *
+ * Building with `-DCUSTOM_COMPONENTS_METRICS` counts the measurements, failures, the time each
+ * measurement takes and the time the component holds the bus in `metrics` (see sensor_metrics.h),
+ * which metrics_export.h serves for Prometheus.
+ *
+ * A sensor is described by a class deriving from this one, passing itself and the struct the
+ * measurement is read into (which should match the bytes sent by the sensor):
+ *
+ * ```
+ * struct MyPayload {
+ *     int16_t value;
+ * };
+ *
+ * class MySensor : public TriggeredI2CSensor<MySensor, MyPayload>, public Sensor {
+ *     public:
+ *     static constexpr const char *tag = "my_sensor"; // The log tag
+ *     static constexpr const char *name = "My Sensor"; // The name shown by dump_config()
+ *     static constexpr uint8_t default_address = 0x10; // The I2C address
+ *     static constexpr uint8_t trigger_register = 0x01; // Written to start a measurement...
+ *     static constexpr int16_t trigger_value = -1; // ...followed by this byte, unless it's -1
+ *     static constexpr uint32_t wait_period = 100; // The time in ms a measurement takes
+ *     static constexpr uint8_t data_register = 0x02; // Written before reading the measurement
+ *
+ *     MySensor(int pollingInterval) : TriggeredI2CSensor(pollingInterval) {}
+ *
+ *     // Called when the sensor comes online (optional)
+ *     void attached() { ... }
+ *     // Called when a measurement, probe or the self-test fails (optional)
+ *     void measurement_failed() { ... }
+ *     // Whether a measurement looks like it came from a working sensor
+ *     static bool plausible(const MyPayload &payload) { return payload.value >= 0; }
+ *     // Decode the measurement and publish it to the sensor's channels
+ *     void publish_payload(const MyPayload &payload) { publish_state(payload.value); }
+ * };
+ * ```
+ */
+template<typename Driver, typename Payload>
+class TriggeredI2CSensor : public PollingComponent {
+    public:
+    TriggeredI2CSensor(int pollingInterval, uint8_t address = Driver::default_address)
+        : PollingComponent(pollingInterval), address(address) {}
+
+    Protothread thread; // Where loop() is up to in taking a measurement
+    TriggeredSensorState step = TriggeredSensorState::IDLE; // The step the measurement is at
+    uint8_t address; // The I2C address of the sensor
+#ifdef ARDUINO
+    I2CBus *bus = wire_bus(); // The bus the sensor is on, the Wire global unless set_bus() is called
+#else
+    I2CBus *bus = nullptr; // The bus the sensor is on, which has to be given with set_bus()
+#endif
+    int8_t schedulerId = -1; // The id of this sensor in the scheduler
+    I2CScheduler *scheduler = nullptr; // The scheduler for a shared bus, if there is one
+    bool online = false; // Whether the sensor has passed its self-test
+    bool again = false; // Whether the driver wants another measurement straight away
+    uint8_t failures = 0; // The number of measurements in a row which have failed
+    uint32_t backoff = 0; // The time to wait before retrying the self-test in ms
+    uint32_t lastSeen = 0; // The last time the sensor answered
+#ifdef CUSTOM_COMPONENTS_LOOP_TIMING
+    LoopTiming timing[TRIGGERED_SENSOR_STEPS]; // The time loop() takes in each step
+#endif
+#ifdef CUSTOM_COMPONENTS_METRICS
+    SensorMetrics metrics; // Counters for monitoring
+    uint32_t requested = 0; // When the measurement was started
+    uint32_t busStart = 0; // When the bus was acquired in us
+#endif
+
+    float get_setup_priority() const override { return esphome::setup_priority::BUS; }
+
+    void setup() override {
+        // This will be called by App.setup()
+        // ESPHome sets up the bus
+        // The sensor is offline until it passes the self-test in loop()
+        if (bus == nullptr) {
+            ESP_LOGE(Driver::tag, "No I2C bus, give the sensor one with set_bus()");
+            mark_failed();
+            return;
+        }
+        status_set_warning();
+    }
+    void dump_config() override {
+        ESP_LOGCONFIG(Driver::tag, "%s:", Driver::name);
+        ESP_LOGCONFIG(Driver::tag, "  Address: 0x%02X", address);
+        ESP_LOGCONFIG(Driver::tag, "  RAM per instance: %u bytes", (unsigned) sizeof(Driver));
+    }
+    void update() override {
+        // This is called every pollingInterval to get a new value
+        // The work is done in loop()
+#ifdef CUSTOM_COMPONENTS_LOOP_TIMING
+        log_timing();
+#endif
+        if (!online) {
+            return;
+        }
+        if (step != TriggeredSensorState::IDLE) {
+            ESP_LOGD(Driver::tag, "Skipping update, the last measurement is still in progress");
+            return;
+        }
+        step = TriggeredSensorState::REQUEST;
+    }
+    // Called when the sensor comes online, drivers hide this if they need to set the sensor up
+    void attached() {}
+    // Called when a measurement fails, drivers hide this if they keep state across measurements
+    void measurement_failed() {}
+    // Use a bus other than the Wire global, must be called before App.setup()
+    void set_bus(I2CBus *bus) { this->bus = bus; }
+    // Share the bus with other components through a scheduler
+    void set_scheduler(I2CScheduler *scheduler, uint8_t priority, uint32_t deadline) {
+        schedulerId = scheduler->add(Driver::tag, priority, deadline);
+        this->scheduler = schedulerId < 0 ? nullptr : scheduler;
+    }
+
+    void loop() override {
+#ifdef CUSTOM_COMPONENTS_LOOP_TIMING
+        // The time is counted against the step loop() started in
+        uint8_t started = (uint8_t) step;
+        uint32_t start = micros();
+        run();
+        timing[started].add(micros() - start);
+#else
+        run();
+#endif
+    }
+
+    protected:
+#ifdef CUSTOM_COMPONENTS_LOOP_TIMING
+    void log_timing() {
+        static const char *const steps[] = {"REQUEST", "WAITING", "READY", "READ", "IDLE", "OFFLINE"};
+        for (uint8_t i = 0; i < TRIGGERED_SENSOR_STEPS; i++) {
+            if (timing[i].count > 0) {
+                ESP_LOGD(Driver::tag, "%s: %u runs, worst %u us, p99.9 under %u us", steps[i],
+                         (unsigned) timing[i].count, (unsigned) timing[i].worst,
+                         (unsigned) timing[i].percentile(999));
+            }
+        }
+    }
+#endif
+
+    // Take a measurement
+    HOT_PATH void run() {
+        ESP_LOGVV(Driver::tag, "STATE: %d", (int) step);
+        PT_BEGIN(thread);
+        if (online) {
+            // Wait for update() to ask for a measurement, checking the sensor is still there if it
+            // hasn't been seen for a while
+            PT_WAIT_UNTIL(thread, step == TriggeredSensorState::REQUEST ||
+                          millis() - lastSeen >= TRIGGERED_SENSOR_PROBE_INTERVAL);
+            if (step != TriggeredSensorState::REQUEST) {
+                PT_WAIT_UNTIL(thread, acquire_idle_bus());
+                if (!probe()) {
+                    failed("has disappeared", true);
+                }
+                PT_RESTART(thread);
+            }
+        } else {
+            step = TriggeredSensorState::OFFLINE;
+            ESP_LOGD(Driver::tag, "Waiting for the sensor at 0x%02X", address);
+            // Wait before retrying a sensor which is there but failed the self-test
+            PT_WAIT_MS(thread, backoff);
+            // Wait for the sensor to answer, only using the bus when it's idle
+            while (true) {
+                PT_WAIT_UNTIL(thread, acquire_idle_bus());
+                if (probe()) {
+                    break;
+                }
+                PT_WAIT_MS(thread, TRIGGERED_SENSOR_PROBE_INTERVAL);
+            }
+            // Run the self-test, which is a measurement that isn't asked for by update()
+            step = TriggeredSensorState::REQUEST;
+        }
+
+        // Tell the sensor to start a measurement, if it doesn't acknowledge it isn't there
+        PT_WAIT_UNTIL(thread, acquire_bus());
+        if (bus->write_register(address, Driver::trigger_register, Driver::trigger_value) != I2CStatus::OK) {
+            release_bus();
+            failed("doesn't acknowledge its address", true);
+            PT_RESTART(thread);
+        }
+        release_bus();
+#ifdef CUSTOM_COMPONENTS_METRICS
+        requested = millis();
+#endif
+
+        // Wait for the measurement to be complete
+        step = TriggeredSensorState::WAITING;
+        PT_WAIT_MS(thread, Driver::wait_period);
+
+        // Read the measurement and publish it
+        step = TriggeredSensorState::READY;
+        PT_WAIT_UNTIL(thread, acquire_bus());
+        step = TriggeredSensorState::READ;
+        if (read_measurement()) {
+            release_bus();
+            passed();
+        } else {
+            release_bus();
+            failed("didn't send a plausible measurement", false);
+        }
+        PT_END(thread);
+    }
+
+    HOT_PATH bool acquire_bus() {
+        return bus_acquired(scheduler == nullptr || scheduler->acquire(schedulerId));
+    }
+    HOT_PATH void release_bus() {
+        if (scheduler != nullptr) {
+            scheduler->release(schedulerId);
+        }
+#ifdef CUSTOM_COMPONENTS_METRICS
+        metrics.busMicros += micros() - busStart;
+#endif
+    }
+    bool acquire_idle_bus() {
+        return bus_acquired(scheduler == nullptr || scheduler->acquire_idle(schedulerId));
+    }
+    HOT_PATH bool bus_acquired(bool acquired) {
+#ifdef CUSTOM_COMPONENTS_METRICS
+        if (acquired) {
+            busStart = micros();
+        }
+#endif
+        return acquired;
+    }
+
+    // Check the sensor acknowledges its address, then release the bus
+    bool probe() {
+        bool answered = bus->probe(address);
+        release_bus();
+        if (answered) {
+            lastSeen = millis();
+        }
+        return answered;
+    }
+
+    // Tell the sensor to send the measurement, then read it and publish it if it's plausible. This
+    // is done in one go so nothing else can use the bus between the request and the read.
+    HOT_PATH bool read_measurement() {
+        Payload payload;
+        if (bus->read_register(address, Driver::data_register, (uint8_t *) &payload, sizeof(payload)) != I2CStatus::OK) {
+            return false;
+        }
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+        log_raw((const uint8_t *) &payload);
+#endif
+        if (!Driver::plausible(payload)) {
+            return false;
+        }
+        static_cast<Driver *>(this)->publish_payload(payload);
+        return true;
+    }
+
+    // Called by the driver from publish_payload() to take another measurement as soon as this one
+    // is done, without waiting for update()
+    void measure_again() { again = true; }
+
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+    // Stream the bytes read from the sensor to the log, as the address and then the bytes in hex
+    void log_raw(const uint8_t *bytes) {
+        static const char digits[] = "0123456789ABCDEF";
+        char hex[sizeof(Payload) * 2 + 1];
+        for (size_t i = 0; i < sizeof(Payload); i++) {
+            hex[i * 2] = digits[bytes[i] >> 4];
+            hex[i * 2 + 1] = digits[bytes[i] & 0x0F];
+        }
+        hex[sizeof(Payload) * 2] = 0;
+        ESP_LOGD(Driver::tag, "raw %02X %s", address, hex);
+    }
+#endif
+
+    // A measurement worked
+    void passed() {
+#ifdef CUSTOM_COMPONENTS_METRICS
+        metrics.sample(millis() - requested);
+#endif
+        failures = 0;
+        lastSeen = millis();
+        step = again ? TriggeredSensorState::REQUEST : TriggeredSensorState::IDLE;
+        again = false;
+        if (!online) {
+            ESP_LOGI(Driver::tag, "Sensor at 0x%02X passed its self-test", address);
+            online = true;
+            backoff = 0;
+            status_clear_warning();
+            static_cast<Driver *>(this)->attached();
+        }
+    }
+
+    // A measurement, probe or the self-test failed, `absent` if the sensor didn't answer at all
+    void failed(const char *reason, bool absent) {
+#ifdef CUSTOM_COMPONENTS_METRICS
+        metrics.errors++;
+#endif
+        step = TriggeredSensorState::IDLE;
+        again = false;
+        static_cast<Driver *>(this)->measurement_failed();
+        if (online && ++failures < TRIGGERED_SENSOR_MAX_FAILURES) {
+            ESP_LOGW(Driver::tag, "Sensor at 0x%02X %s", address, reason);
+            return;
+        }
+        if (online) {
+            ESP_LOGW(Driver::tag, "Sensor at 0x%02X %s, taking it offline", address, reason);
+            online = false;
+            failures = 0;
+            backoff = 0;
+            status_set_warning();
+        } else if (!absent) {
+            backoff = backoff == 0 ? TRIGGERED_SENSOR_RETRY_MIN : backoff * 2;
+            if (backoff > TRIGGERED_SENSOR_RETRY_MAX) {
+                backoff = TRIGGERED_SENSOR_RETRY_MAX;
+            }
+            ESP_LOGW(Driver::tag, "Sensor at 0x%02X %s, retrying in %u s", address, reason, (unsigned) (backoff / 1000));
+        }
+    }
+};
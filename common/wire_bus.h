@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+#include "i2c_bus.h"
+
+// An I2CBus on an Arduino TwoWire, e.g. the Wire global that ESPHome sets up
+class WireBus : public I2CBus {
+    public:
+    WireBus(TwoWire *wire = &Wire) : wire(wire) {}
+
+    void wait(uint32_t ms) override { delay(ms); }
+    uint32_t micros() override { return ::micros(); }
+
+    protected:
+    TwoWire *wire;
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        wire->beginTransmission(address);
+        if (length > 0) {
+            wire->write(data, length);
+        }
+        return status(wire->endTransmission());
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        if (wire->requestFrom(address, (uint8_t) length) != length) {
+            return I2CStatus::SHORT;
+        }
+        wire->readBytes(data, length);
+        return I2CStatus::OK;
+    }
+
+    // The result of endTransmission(): 2 and 3 are NACKs of the address and data
+    static I2CStatus status(uint8_t result) {
+        if (result == 0) {
+            return I2CStatus::OK;
+        }
+        return result == 2 || result == 3 ? I2CStatus::NACK : I2CStatus::ERROR;
+    }
+};
+
+// The bus the components use unless they're given another, the Wire global
+inline I2CBus *wire_bus() {
+    static WireBus bus;
+    return &bus;
+}
@@ -1,23 +1,21 @@
-#include "Wire.h"
+#pragma once
 #include "esphome.h"
-#define address 0x74 // Default address for the sensor
-#define wait_period 50 // Time to wait for a measurement
-
-// The various states the component can be in
-enum Sen0590SensorState { 
-    REQUEST, // Request a new measurement
-    WAITING, // Waiting for the measurement
-    READY, // Ready to request the measurement value
-    READ, // Requesting the measurement value
-    IDLE // There is no request in progress
-};
+#include "triggered_i2c_sensor.h"
+#include "sen0590_protocol.h"
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+#include "rollup_sensors.h"
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+#include "sample_history.h"
+#endif
 
 /*
  * An ESPHome component for the Laser Ranging Sensor (4m) which has the SKU SEN0590 made by DFRobot. 
  * It's based on their Arduino example code which on their wiki 
  * https://wiki.dfrobot.com/Laser_Ranging_Sensor_4m_SKU_SEN0590 but replaces the various delays
- * they use with a very basic state machine, and uses millis() to work out when the sensor is ready
- * to avoid blocking the loop.
+ * they use with a protothread which waits for the sensor to be ready without blocking the loop. The
+ * protothread is generated by TriggeredI2CSensor (see common/triggered_i2c_sensor.h) from the
+ * description of the sensor in sen0590_protocol.h, which is shared with the host tools.
  * 
  *
  * To use it, enable the I2C bus:
@@ -33,6 +31,19 @@ enum Sen0590SensorState {
  * 
  * ```
  * includes:
+ *   - custom_components/common/hot_path.h
+ *   - custom_components/common/fixed_calibration.h
+ *   - custom_components/common/i2c_bus.h
+ *   - custom_components/common/i2c_scheduler.h
+ *   - custom_components/common/loop_timing.h
+ *   - custom_components/common/protothread.h
+ *   - custom_components/common/triggered_i2c_sensor.h
+ *   - custom_components/common/wire_bus.h
+ *   - custom_components/common/rollup.h
+ *   - custom_components/common/rollup_sensors.h
+ *   - custom_components/common/sample_history.h
+ *   - custom_components/common/sensor_metrics.h
+ *   - custom_components/dfrobot-sen-590/sen0590_protocol.h
  *   - custom_components/dfrobot-sen-590/sen0590.h
  * ```
  * 
@@ -42,9 +53,9 @@ enum Sen0590SensorState {
  * sensor:
  *   - platform: custom
  *     lambda: |-
- *       auto sensor = new Sen0590(5000);
- *       App.register_component(sensor);
- *       return {sensor};
+ *       static Sen0590 sensor(5000);
+ *       App.register_component(&sensor);
+ *       return {&sensor};
  * 
  *   sensors:
  *     name: Distance
@@ -57,64 +68,166 @@ enum Sen0590SensorState {
  * 
  * The precision on this sensor is dependent on what you are measuring the distance towards (as it
  * depends what the laser can bounce off) so using some filters on the raw value is useful.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_RAW_CHANNELS` the bytes read from the sensor are logged, and
+ * the distance it sent (before the calibration) is published on `raw_sensor`, so add
+ * `&sensor.raw_sensor` to the sensors returned by the lambda.
+ *
+ * By default 10mm is added to the distance. Each module can be calibrated against a reference
+ * instead with `sensor.set_calibration(offset, scale, quadratic)` in the lambda, which is applied
+ * in fixed point (see common/fixed_calibration.h) to the distance in mm.
+ *
+ * The noise depends on the surface too, so rather than averaging a fixed number of readings with
+ * filters, `sensor.set_adaptive_averaging(minWindow, maxWindow, quiet, noisy)` makes it measure
+ * several times (back to back) for each published distance, only when it needs to: the number of
+ * measurements averaged doubles when their noise (standard deviation in mm) is above `noisy`, and
+ * halves when it's below `quiet`. A stable target is then published with low latency, and a noisy
+ * one accurately. The polling interval needs to allow for maxWindow * 50ms of measurements.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_ROLLUPS` the minimum, maximum and mean distance over each
+ * minute, hour and day are kept on the device (see common/rollup.h). Publish the ones you want with
+ * e.g. `sensor.rollup.set_sensor(ROLLUP_HOUR, ROLLUP_MAX, &hourlyMax)`.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_HISTORY` the last SAMPLE_HISTORY_CAPACITY distances published
+ * are kept in `sensor.history`, which can be downloaded from the web server with
+ * common/history_export.h.
+ *
+ * The component is a function-local static rather than allocated with `new`, so the object itself
+ * lives in .bss. ESPHome still allocates for the Sensor it derives from (its name, filters and
+ * callbacks) when it's set up. host/heap_bench.cpp measures the component making no allocations of
+ * its own once running.
+ *
+ * If the sensor isn't at the default address (0x74) pass its address as the second argument of the
+ * constructor.
+ *
+ * To drive it from a clock shared with other sensors, so their samples are taken together, see
+ * common/acquisition_clock.h. If it shares the bus with other sensors and needs its readings taken on
+ * time, give it a priority and deadline with set_scheduler() (see common/i2c_scheduler.h).
  */
-class Sen0590 : public PollingComponent, public Sensor {
+class Sen0590 : public TriggeredI2CSensor<Sen0590, Sen0590Payload>, public Sensor, public Sen0590Protocol {
     public:
+
+    FixedCalibration calibration{10.0f}; // The sensor reads 10mm short
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+    Sensor raw_sensor; // The distance as sent by the sensor, without the calibration
+#endif
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+    RollupSensors rollup; // Minute, hour and day statistics of the distance in mm
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+    StaticSampleHistory<1> history{"distance", 1}; // The latest distances in mm
+#endif
+
+    // Adaptive averaging, off unless maxWindow is more than 1
+    uint8_t minWindow = 1; // The fewest measurements averaged for each published distance
+    uint8_t maxWindow = 1; // The most measurements averaged for each published distance
+    uint8_t window = 1; // The number of measurements being averaged
+    uint8_t samples = 0; // The number of measurements taken towards this average
+    uint8_t pairs = 0; // The number of differences between consecutive measurements in diffSquares
+    bool haveLast = false; // Whether there is a previous measurement to compare with
+    uint16_t last = 0; // The previous measurement in mm
+    uint16_t quiet = 0; // The noise (standard deviation in mm) below which the window shrinks
+    uint16_t noisy = 0; // The noise above which the window grows
+    uint32_t sum = 0; // The sum of the measurements towards this average
+    uint64_t diffSquares = 0; // The sum of the squared differences between consecutive measurements
+
     // constructor
-    Sen0590(int pollingInterval) : PollingComponent(pollingInterval) {}
+    Sen0590(int pollingInterval, uint8_t address = default_address) : TriggeredI2CSensor(pollingInterval, address) {}
 
-    unsigned long startRequest = 0UL; // The time the REQUEST state is entered
-    Sen0590SensorState state = IDLE; // The sensor state machine
+    // Correct the distance in mm, replacing the default 10mm offset. Coefficients which don't fit
+    // the fixed point (see common/fixed_calibration.h) are logged and ignored
+    void set_calibration(float offset, float scale = 1.0f, float quadratic = 0.0f) {
+        if (!FixedCalibration::fits(offset, scale, quadratic)) {
+            ESP_LOGE(tag, "Calibration %g + %g x + %g x^2 is out of range, ignoring it", offset, scale, quadratic);
+            return;
+        }
+        calibration = FixedCalibration(offset, scale, quadratic);
+    }
 
-    float get_setup_priority() const override { return esphome::setup_priority::BUS; }
+    // Average between minWindow and maxWindow measurements for each published distance, doubling
+    // the number when the noise is above `noisy` mm and halving it when it's below `quiet` mm
+    void set_adaptive_averaging(uint8_t minWindow, uint8_t maxWindow, uint16_t quiet, uint16_t noisy) {
+        this->minWindow = minWindow < 1 ? 1 : minWindow;
+        this->maxWindow = maxWindow < this->minWindow ? this->minWindow : maxWindow;
+        this->quiet = quiet;
+        this->noisy = noisy;
+        window = this->minWindow;
+    }
 
-    void setup() override {
-        // This will be called by App.setup()
-        // ESPHome calls Wire.begin()
+    // A new sensor may be pointing at something else, so start the averaging again
+    void attached() {
+        window = minWindow;
+        measurement_failed();
     }
-    void update() override {
-        state = REQUEST;
+
+    // The measurements either side of a failed one may be far apart in time, so start the window
+    // again rather than averaging across the gap
+    void measurement_failed() {
+        samples = 0;
+        pairs = 0;
+        haveLast = false;
+        sum = 0;
+        diffSquares = 0;
     }
 
-    void loop() override {
-        ESP_LOGVV("sen0590", "STATE: %d", state);
-        switch(state) {
-            // Request a measurement is made
-            case REQUEST:
-                Wire.beginTransmission(address);
-                Wire.write(0x10);
-                Wire.write(0xB0);
-                Wire.endTransmission();
-                state = WAITING;
-                startRequest = millis();
-                break;
-            case WAITING:
-                // Wait for the measurement to be complete
-                if (wait_period < millis() - startRequest) {
-                    state = READY;
-                }
-                break;
-            case READY:
-                // Tell the sensor to send the measurement
-                Wire.beginTransmission(address);
-                Wire.write(0x02);
-                if (Wire.endTransmission() != 0) {
-                    return;
-                }
-                Wire.requestFrom(address, 2);
-                state = READ;
-                break;
-            case READ:
-                // Read the measurement and publish it
-                if(Wire.available() == 2) {
-                    int buf[2] = { 0 };
-                    for (int i = 0; i < 2; i++) {
-                        buf[i] = Wire.read();
-                    }
-                    int distance = (buf[0] * 0x100 + buf[1] + 10);
-                    publish_state(distance);
-                }
-                break;
+    HOT_PATH void publish_payload(const Sen0590Payload &payload) {
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+        raw_sensor.publish_state(payload.distance_mm());
+#endif
+        uint16_t distance = payload.distance_mm();
+        if (maxWindow <= 1) {
+            publish_distance(calibration.apply(distance));
+            return;
+        }
+        // The noise is estimated from the differences between consecutive measurements, which
+        // isn't thrown off by the target moving slowly
+        if (haveLast) {
+            uint32_t difference = distance > last ? distance - last : last - distance;
+            diffSquares += difference * difference;
+            pairs++;
+        }
+        haveLast = true;
+        last = distance;
+        sum += distance;
+        if (++samples < window) {
+            measure_again();
+            return;
+        }
+        publish_distance(calibration.apply((sum + samples / 2) / samples));
+        adapt_window();
+        samples = 0;
+        pairs = 0;
+        sum = 0;
+        diffSquares = 0;
+    }
+
+    protected:
+    HOT_PATH void publish_distance(int32_t distance) {
+        publish_state(distance);
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+        rollup.add(distance, millis(), 1.0f);
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+        int16_t sample = SampleHistory::clamp(distance);
+        history.add(millis(), &sample);
+#endif
+    }
+
+    // Change the number of measurements averaged depending on the noise in the last ones
+    void adapt_window() {
+        if (pairs == 0) {
+            return;
+        }
+        // Half the mean squared difference estimates the variance
+        uint64_t variance = diffSquares / (2 * pairs);
+        uint8_t previous = window;
+        if (variance > (uint32_t) noisy * noisy && window < maxWindow) {
+            window = window * 2 > maxWindow ? maxWindow : window * 2;
+        } else if (variance < (uint32_t) quiet * quiet && window > minWindow) {
+            window = window / 2 < minWindow ? minWindow : window / 2;
+        }
+        if (window != previous) {
+            ESP_LOGD(tag, "Averaging %u measurements", (unsigned) window);
         }
     }
 };
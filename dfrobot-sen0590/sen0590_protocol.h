@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include "hot_path.h"
+
+// A measurement as sent by the sensor
+struct Sen0590Payload {
+    uint8_t distance[2]; // Big-endian distance in mm
+
+    HOT_PATH uint16_t distance_mm() const { return (distance[0] << 8) | distance[1]; }
+};
+
+/*
+ * How a DFRobot SEN0590 is talked to over I2C: write 0xB0 to register 0x10 to start a measurement,
+ * wait 50ms, then read the distance from register 0x02. This doesn't depend on ESPHome, the same
+ * description drives the ESPHome component (sen0590.h) and the host tools (see host/).
+ */
+struct Sen0590Protocol {
+    using Payload = Sen0590Payload;
+
+    static constexpr const char *tag = "sen0590";
+    static constexpr const char *name = "DFRobot SEN0590";
+    static constexpr uint8_t default_address = 0x74; // Default address for the sensor
+    static constexpr uint8_t trigger_register = 0x10; // Start a measurement...
+    static constexpr int16_t trigger_value = 0xB0;
+    static constexpr uint32_t wait_period = 50; // Time to wait for a measurement
+    static constexpr uint8_t data_register = 0x02; // The measurement
+
+    // All ones is what's read if the sensor stops driving the bus
+    static bool plausible(const Sen0590Payload &payload) {
+        return payload.distance_mm() != 0xFFFF;
+    }
+};
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive.h"
+#include "telemetry.h"
+#include "telemetry_archive.h"
+
+/*
+ * Keeps the nodes' history frames (downloaded from /history/<name>.bin, see
+ * common/history_export.h) in an archive (see archive.h), and reads it back:
+ *
+ * ```
+ * archive append <archive> <node> [-c <history>=<columns>]... [[-t <received>] <frame.bin>...]...
+ * archive info <archive>
+ * archive scan <archive> <sensor> [from] [to]
+ * ```
+ *
+ * Each channel of a history is a sensor called <node>/<history>/<column>, with the columns named
+ * by -c (e.g. `-c leaf_61=temperature,wetness`) or channel0, channel1... The frames are given in the
+ * order they were received, at the time (ms since the epoch) given by the -t before them or when
+ * append is run. The samples are timed from the first frame after the node starts and then by its
+ * uptime. The node's uptime and boot id are archived too, so the samples already archived are
+ * skipped however late the frames are appended (see telemetry_archive.h). scan prints the samples
+ * of a sensor as CSV, between two times in ms since the epoch.
+ */
+
+static int append(int argc, char **argv) {
+    ArchiveWriter writer(argv[2]);
+    if (!writer.ok()) {
+        return 1;
+    }
+    std::string node = argv[3];
+
+    // The files in the order they're given, received now unless -t says when
+    TelemetryEngine engine;
+    int64_t received = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            const char *equals = strchr(argv[++i], '=');
+            if (equals != nullptr) {
+                engine.set_columns(std::string(argv[i], equals - argv[i]), equals + 1);
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            received = strtoll(argv[++i], nullptr, 0);
+            continue;
+        }
+        FILE *input = fopen(argv[i], "rb");
+        if (input == nullptr) {
+            perror(argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        }
+        fclose(input);
+        if (!engine.ingest(node, received, bytes.data(), bytes.size())) {
+            fprintf(stderr, "%s: not a history frame\n", argv[i]);
+            return 1;
+        }
+    }
+
+    ArchiveReader reader(argv[2]);
+    uint64_t added = 0;
+    engine.for_each([&](const TelemetrySeries &series) { added += archive_series(writer, reader, series); });
+    if (!writer.sync()) {
+        return 1;
+    }
+    printf("Added %llu samples\n", (unsigned long long) added);
+    return 0;
+}
+
+static int info(char **argv) {
+    ArchiveReader reader(argv[2]);
+    if (!reader.ok()) {
+        return 1;
+    }
+    std::vector<uint64_t> counts(reader.sensors.size(), 0);
+    std::vector<int64_t> first(reader.sensors.size(), INT64_MAX), last(reader.sensors.size(), INT64_MIN);
+    uint64_t rows = reader.scan(INT64_MIN, INT64_MAX, ARCHIVE_ALL_SENSORS, [&](int64_t time, uint32_t sensor, int32_t) {
+        counts[sensor]++;
+        first[sensor] = std::min(first[sensor], time);
+        last[sensor] = std::max(last[sensor], time);
+    });
+    printf("%llu rows in %zu blocks, %zu bytes, %.2f bytes per row\n", (unsigned long long) rows,
+           reader.blocks.size(), reader.end, rows == 0 ? 0.0 : (double) reader.end / rows);
+    for (size_t i = 0; i < reader.sensors.size(); i++) {
+        printf("%u %s: %llu samples from %lld to %lld, divisor %u\n", (unsigned) i, reader.sensors[i].name.c_str(),
+               (unsigned long long) counts[i], (long long) first[i], (long long) last[i],
+               (unsigned) reader.sensors[i].divisor);
+    }
+    return 0;
+}
+
+static int scan(int argc, char **argv) {
+    ArchiveReader reader(argv[2]);
+    if (!reader.ok()) {
+        return 1;
+    }
+    int64_t sensor = reader.sensor(argv[3]);
+    if (sensor < 0) {
+        fprintf(stderr, "unknown sensor %s\n", argv[3]);
+        return 1;
+    }
+    int64_t from = argc > 4 ? strtoll(argv[4], nullptr, 0) : INT64_MIN;
+    int64_t to = argc > 5 ? strtoll(argv[5], nullptr, 0) : INT64_MAX;
+    float divisor = reader.sensors[sensor].divisor;
+    printf("time,%s\n", argv[3]);
+    reader.scan(from, to, sensor, [&](int64_t time, uint32_t, int32_t value) {
+        printf("%lld,%g\n", (long long) time, value / divisor);
+    });
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 5 && strcmp(argv[1], "append") == 0) {
+        return append(argc, argv);
+    }
+    if (argc == 3 && strcmp(argv[1], "info") == 0) {
+        return info(argv);
+    }
+    if (argc >= 4 && strcmp(argv[1], "scan") == 0) {
+        return scan(argc, argv);
+    }
+    fprintf(stderr, "usage: %s append <archive> <node> [-c <history>=<columns>]... [[-t <received>] <frame.bin>...]...\n"
+                    "       %s info <archive>\n"
+                    "       %s scan <archive> <sensor> [from] [to]\n", argv[0], argv[0], argv[0]);
+    return 2;
+}
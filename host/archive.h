@@ -0,0 +1,470 @@
+#pragma once
+#include <algorithm>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// The most rows in a block, the unit the archive is written and scanned in
+#ifndef ARCHIVE_BLOCK_ROWS
+#define ARCHIVE_BLOCK_ROWS 65536
+#endif
+
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 16
+#define ARCHIVE_BLOCK_HEADER_SIZE 48
+#define ARCHIVE_SENSOR_HEADER_SIZE 12
+#define ARCHIVE_RUN_SIZE 16
+// Scan every sensor
+#define ARCHIVE_ALL_SENSORS UINT32_MAX
+
+/*
+ * An append-only file of sensor samples for keeping years of history, written by the host tools
+ * from the nodes' telemetry and read through mmap. Each row is a time (ms since the epoch), a sensor
+ * id and an integer value in the sensor's units (e.g. hundredths of a %). Everything is
+ * little-endian.
+ *
+ * The file is a 16 byte header ("CCAR", ARCHIVE_VERSION, then zeros) followed by records:
+ *
+ * - A sensor: "CCAS", its id (4 bytes), divisor (2), the length of its name (2), then the name.
+ *   Sensors are numbered from 0 in the order they're added.
+ * - A block of up to ARCHIVE_BLOCK_ROWS rows: a 48 byte header, then the sensor, time and value
+ *   columns one after the other.
+ *
+ * | Offset | Size | Block header field                                 |
+ * |--------|------|----------------------------------------------------|
+ * | 0      | 4    | "CCAB"                                             |
+ * | 4      | 4    | The number of rows                                 |
+ * | 8      | 8    | The earliest time                                  |
+ * | 16     | 8    | The latest time                                    |
+ * | 24     | 4    | The lowest sensor id                               |
+ * | 28     | 4    | The highest sensor id                              |
+ * | 32     | 4    | The number of runs in the sensor column            |
+ * | 36     | 4    | The size of the time column in bytes               |
+ * | 40     | 4    | The size of the value column in bytes              |
+ * | 44     | 4    | Zero                                               |
+ *
+ * The rows of a block are sorted by sensor and then time. The sensor column is run-length encoded:
+ * for each sensor, its id, number of rows, and where its rows start in the time and value columns
+ * (4 bytes each). In the time and value columns each row is the difference from the sensor's
+ * previous row (its first row from 0) as a zigzag varint. With samples every few seconds a row is
+ * around 4 bytes rather than 16.
+ *
+ * A scan skips the blocks outside its times and sensors using only their headers, and the other
+ * sensors' rows using the sensor column, and stops decoding a sensor's rows after its end time.
+ *
+ * Records are only ever added, so readers can scan while a writer appends. A record cut short (e.g.
+ * by a crash while writing) is ignored by readers and overwritten by the next writer.
+ */
+
+inline void archive_put(uint8_t *buffer, uint64_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        buffer[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+inline uint64_t archive_get(const uint8_t *buffer, uint8_t size) {
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        value |= (uint64_t) buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+// Append a signed value as a zigzag varint
+inline void archive_put_varint(std::vector<uint8_t> &buffer, int64_t value) {
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    while (zigzag >= 0x80) {
+        buffer.push_back((uint8_t) zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    buffer.push_back((uint8_t) zigzag);
+}
+
+// Read a zigzag varint, advancing the position
+inline int64_t archive_get_varint(const uint8_t *&buffer) {
+    uint64_t zigzag = 0;
+    for (uint8_t shift = 0;; shift += 7) {
+        uint8_t byte = *buffer++;
+        zigzag |= (uint64_t) (byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            break;
+        }
+    }
+    return (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+}
+
+struct ArchiveSensor {
+    std::string name;
+    uint16_t divisor; // The values are in units of 1/divisor
+};
+
+struct ArchiveBlock {
+    size_t offset; // Of its columns in the file
+    uint32_t rows;
+    int64_t minTime;
+    int64_t maxTime;
+    uint32_t minSensor;
+    uint32_t maxSensor;
+    uint32_t runs; // The number of sensors in the block
+    uint32_t timeBytes;
+    uint32_t valueBytes;
+};
+
+/*
+ * Reads an archive through mmap. The sensors and block headers are read when it's opened, and
+ * refresh() picks up what's been appended since.
+ */
+class ArchiveReader {
+    public:
+    std::vector<ArchiveSensor> sensors;
+    std::vector<ArchiveBlock> blocks;
+    size_t end = 0; // The end of the last complete record
+
+    ArchiveReader(const char *path) : fd(open(path, O_RDONLY)) {
+        if (fd < 0) {
+            perror(path);
+        } else if (!refresh()) {
+            fprintf(stderr, "%s: not an archive\n", path);
+            close(fd);
+            fd = -1;
+        }
+    }
+    ArchiveReader(const ArchiveReader &) = delete;
+    ArchiveReader &operator=(const ArchiveReader &) = delete;
+    ~ArchiveReader() {
+        unmap();
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Whether the archive was opened
+    bool ok() const { return fd >= 0; }
+
+    // Map the file again and read the records appended since, false if it isn't an archive
+    bool refresh() {
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            return false;
+        }
+        unmap();
+        size = status.st_size;
+        if (size < ARCHIVE_HEADER_SIZE) {
+            return false;
+        }
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        data = (const uint8_t *) mapped;
+        // Scans read the blocks in order
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        if (memcmp(data, "CCAR", 4) != 0 || data[4] != ARCHIVE_VERSION) {
+            return false;
+        }
+        if (end == 0) {
+            end = ARCHIVE_HEADER_SIZE;
+        }
+        while (read_record()) {
+        }
+        return true;
+    }
+
+    // The id of a sensor, or -1
+    int64_t sensor(const std::string &name) const {
+        for (size_t i = 0; i < sensors.size(); i++) {
+            if (sensors[i].name == name) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    uint64_t rows() const {
+        uint64_t total = 0;
+        for (const ArchiveBlock &block : blocks) {
+            total += block.rows;
+        }
+        return total;
+    }
+
+    // The last row written for a sensor, which is its latest if its rows were appended in time order,
+    // false if it has none. Only the sensor's run in the last block with it is decoded
+    bool last(uint32_t sensor, int64_t &time, int32_t &value) const {
+        for (size_t b = blocks.size(); b-- > 0;) {
+            const ArchiveBlock &block = blocks[b];
+            if (sensor < block.minSensor || sensor > block.maxSensor) {
+                continue;
+            }
+            const uint8_t *runs = data + block.offset;
+            for (uint32_t run = 0; run < block.runs; run++) {
+                const uint8_t *entry = runs + run * ARCHIVE_RUN_SIZE;
+                if (archive_get(entry, 4) != sensor) {
+                    continue;
+                }
+                uint32_t count = archive_get(entry + 4, 4);
+                const uint8_t *times = runs + block.runs * ARCHIVE_RUN_SIZE;
+                const uint8_t *nextTime = times + archive_get(entry + 8, 4);
+                const uint8_t *nextValue = times + block.timeBytes + archive_get(entry + 12, 4);
+                int64_t t = 0, v = 0;
+                for (uint32_t row = 0; row < count; row++) {
+                    t += archive_get_varint(nextTime);
+                    v += archive_get_varint(nextValue);
+                }
+                time = t;
+                value = (int32_t) v;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Call visit(time, sensor, value) for each row of a sensor (or ARCHIVE_ALL_SENSORS) in
+    // [from, to), returning the number of rows. The rows are in order within each block, and the
+    // blocks in the order they were written.
+    template<typename Visit>
+    uint64_t scan(int64_t from, int64_t to, uint32_t sensor, Visit visit) const {
+        uint64_t visited = 0;
+        for (const ArchiveBlock &block : blocks) {
+            if (block.maxTime < from || block.minTime >= to ||
+                (sensor != ARCHIVE_ALL_SENSORS && (sensor < block.minSensor || sensor > block.maxSensor))) {
+                continue;
+            }
+            const uint8_t *runs = data + block.offset;
+            const uint8_t *times = runs + block.runs * ARCHIVE_RUN_SIZE;
+            const uint8_t *values = times + block.timeBytes;
+            for (uint32_t run = 0; run < block.runs; run++) {
+                const uint8_t *entry = runs + run * ARCHIVE_RUN_SIZE;
+                uint32_t id = archive_get(entry, 4);
+                if (sensor != ARCHIVE_ALL_SENSORS && id != sensor) {
+                    continue;
+                }
+                uint32_t count = archive_get(entry + 4, 4);
+                const uint8_t *time = times + archive_get(entry + 8, 4);
+                const uint8_t *value = values + archive_get(entry + 12, 4);
+                int64_t t = 0, v = 0;
+                for (uint32_t row = 0; row < count; row++) {
+                    t += archive_get_varint(time);
+                    v += archive_get_varint(value);
+                    if (t >= to) {
+                        break;
+                    }
+                    if (t >= from) {
+                        visit(t, id, (int32_t) v);
+                        visited++;
+                    }
+                }
+            }
+        }
+        return visited;
+    }
+
+    protected:
+    int fd;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    void unmap() {
+        if (data != nullptr) {
+            munmap((void *) data, size);
+            data = nullptr;
+        }
+    }
+
+    // Read the record at the end, false if there isn't a complete one
+    bool read_record() {
+        if (end + 4 > size) {
+            return false;
+        }
+        const uint8_t *record = data + end;
+        if (memcmp(record, "CCAS", 4) == 0) {
+            if (end + ARCHIVE_SENSOR_HEADER_SIZE > size) {
+                return false;
+            }
+            uint16_t length = archive_get(record + 10, 2);
+            if (end + ARCHIVE_SENSOR_HEADER_SIZE + length > size || archive_get(record + 4, 4) != sensors.size()) {
+                return false;
+            }
+            sensors.push_back({std::string((const char *) record + ARCHIVE_SENSOR_HEADER_SIZE, length),
+                               (uint16_t) archive_get(record + 8, 2)});
+            end += ARCHIVE_SENSOR_HEADER_SIZE + length;
+            return true;
+        }
+        if (memcmp(record, "CCAB", 4) == 0) {
+            if (end + ARCHIVE_BLOCK_HEADER_SIZE > size) {
+                return false;
+            }
+            ArchiveBlock block;
+            block.offset = end + ARCHIVE_BLOCK_HEADER_SIZE;
+            block.rows = archive_get(record + 4, 4);
+            block.minTime = archive_get(record + 8, 8);
+            block.maxTime = archive_get(record + 16, 8);
+            block.minSensor = archive_get(record + 24, 4);
+            block.maxSensor = archive_get(record + 28, 4);
+            block.runs = archive_get(record + 32, 4);
+            block.timeBytes = archive_get(record + 36, 4);
+            block.valueBytes = archive_get(record + 40, 4);
+            uint64_t bytes = (uint64_t) block.runs * ARCHIVE_RUN_SIZE + block.timeBytes + block.valueBytes;
+            if (block.offset + bytes > size) {
+                return false;
+            }
+            blocks.push_back(block);
+            end = block.offset + bytes;
+            return true;
+        }
+        return false;
+    }
+};
+
+/*
+ * Appends to an archive, creating it if it doesn't exist. Rows are buffered and written a block at
+ * a time, when ARCHIVE_BLOCK_ROWS have been added or on flush(). A record cut short at the end of
+ * the file is overwritten.
+ */
+class ArchiveWriter {
+    public:
+    ArchiveWriter(const char *path) : fd(open(path, O_RDWR | O_CREAT, 0644)) {
+        if (fd < 0) {
+            perror(path);
+            return;
+        }
+        if (lseek(fd, 0, SEEK_END) == 0) {
+            uint8_t header[ARCHIVE_HEADER_SIZE] = {'C', 'C', 'A', 'R', ARCHIVE_VERSION};
+            if (!write_all(header, sizeof(header))) {
+                perror(path);
+                close(fd);
+                fd = -1;
+                return;
+            }
+        }
+        ArchiveReader reader(path);
+        if (!reader.ok()) {
+            close(fd);
+            fd = -1;
+            return;
+        }
+        sensors = reader.sensors;
+        ftruncate(fd, reader.end);
+        lseek(fd, reader.end, SEEK_SET);
+    }
+    ArchiveWriter(const ArchiveWriter &) = delete;
+    ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+    ~ArchiveWriter() {
+        if (fd >= 0) {
+            flush();
+            close(fd);
+        }
+    }
+
+    // Whether the archive was opened
+    bool ok() const { return fd >= 0; }
+
+    // The id of a sensor, adding it if it's new
+    uint32_t sensor(const std::string &name, uint16_t divisor = 1) {
+        for (size_t i = 0; i < sensors.size(); i++) {
+            if (sensors[i].name == name) {
+                return i;
+            }
+        }
+        uint8_t header[ARCHIVE_SENSOR_HEADER_SIZE];
+        memcpy(header, "CCAS", 4);
+        archive_put(header + 4, sensors.size(), 4);
+        archive_put(header + 8, divisor, 2);
+        archive_put(header + 10, name.size(), 2);
+        // Any rows buffered for sensors already written go first, so readers always know the sensor
+        flush();
+        write_all(header, sizeof(header));
+        write_all((const uint8_t *) name.data(), name.size());
+        sensors.push_back({name, divisor});
+        return sensors.size() - 1;
+    }
+    const std::vector<ArchiveSensor> &sensor_list() const { return sensors; }
+
+    void append(int64_t time, uint32_t sensor, int32_t value) {
+        rows.push_back({time, sensor, value});
+        if (rows.size() >= ARCHIVE_BLOCK_ROWS) {
+            flush();
+        }
+    }
+
+    // Write the rows buffered as a block, false if it failed
+    bool flush() {
+        if (rows.empty()) {
+            return true;
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return a.sensor != b.sensor ? a.sensor < b.sensor : a.time < b.time;
+        });
+        for (std::vector<uint8_t> &column : columns) {
+            column.clear();
+        }
+        int64_t minTime = INT64_MAX, maxTime = INT64_MIN;
+        Row previous = {0, 0, 0};
+        for (size_t i = 0; i < rows.size(); i++) {
+            const Row &row = rows[i];
+            if (i == 0 || row.sensor != rows[i - 1].sensor) {
+                // Start a run, its deltas are from 0
+                size_t run = columns[0].size();
+                columns[0].resize(run + ARCHIVE_RUN_SIZE);
+                archive_put(&columns[0][run], row.sensor, 4);
+                archive_put(&columns[0][run + 8], columns[1].size(), 4);
+                archive_put(&columns[0][run + 12], columns[2].size(), 4);
+                previous = {0, row.sensor, 0};
+            }
+            // The run's number of rows
+            size_t run = columns[0].size() - ARCHIVE_RUN_SIZE;
+            archive_put(&columns[0][run + 4], archive_get(&columns[0][run + 4], 4) + 1, 4);
+            archive_put_varint(columns[1], row.time - previous.time);
+            archive_put_varint(columns[2], (int64_t) row.value - previous.value);
+            minTime = std::min(minTime, row.time);
+            maxTime = std::max(maxTime, row.time);
+            previous = row;
+        }
+        uint8_t header[ARCHIVE_BLOCK_HEADER_SIZE] = {'C', 'C', 'A', 'B'};
+        archive_put(header + 4, rows.size(), 4);
+        archive_put(header + 8, minTime, 8);
+        archive_put(header + 16, maxTime, 8);
+        archive_put(header + 24, rows.front().sensor, 4);
+        archive_put(header + 28, rows.back().sensor, 4);
+        archive_put(header + 32, columns[0].size() / ARCHIVE_RUN_SIZE, 4);
+        archive_put(header + 36, columns[1].size(), 4);
+        archive_put(header + 40, columns[2].size(), 4);
+        rows.clear();
+        return write_all(header, sizeof(header)) && write_all(columns[0].data(), columns[0].size()) &&
+               write_all(columns[1].data(), columns[1].size()) && write_all(columns[2].data(), columns[2].size());
+    }
+
+    // Flush and wait for the data to reach the disk
+    bool sync() { return flush() && fsync(fd) == 0; }
+
+    protected:
+    struct Row {
+        int64_t time;
+        uint32_t sensor;
+        int32_t value;
+    };
+
+    int fd;
+    std::vector<ArchiveSensor> sensors;
+    std::vector<Row> rows;
+    std::vector<uint8_t> columns[3]; // The sensor, time and value columns of the block being written
+
+    bool write_all(const uint8_t *buffer, size_t length) {
+        while (length > 0) {
+            ssize_t written = write(fd, buffer, length);
+            if (written < 0) {
+                perror("archive");
+                return false;
+            }
+            buffer += written;
+            length -= written;
+        }
+        return true;
+    }
+};
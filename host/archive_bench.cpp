@@ -0,0 +1,219 @@
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "archive.h"
+#ifdef ARCHIVE_BENCH_SQLITE
+#include <sqlite3.h>
+#endif
+
+/*
+ * Compares an archive (see archive.h) with CSV and SQLite for storing and scanning sensor history:
+ *
+ * ```
+ * archive_bench [sensors] [days] [directory]
+ * ```
+ *
+ * Each sensor has a sample a minute. The same rows are written to each format, then each is
+ * scanned for the count and sum of one sensor's values over a day, all the sensors' over a week, and
+ * everything. The files stay in the page cache, so the scans measure decoding rather than the disk.
+ * SQLite is included when the Makefile finds it, with a (sensor, time) primary key.
+ */
+
+#define SAMPLE_INTERVAL 60000
+#define DAY 86400000LL
+
+struct Result {
+    uint64_t count = 0;
+    int64_t sum = 0;
+};
+
+// A query: one sensor (or ARCHIVE_ALL_SENSORS) over [from, to)
+struct Query {
+    const char *name;
+    uint32_t sensor;
+    int64_t from;
+    int64_t to;
+};
+
+template<typename Function>
+static double seconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static size_t file_size(const std::string &path) {
+    struct stat status;
+    return stat(path.c_str(), &status) == 0 ? status.st_size : 0;
+}
+
+// A leaf wetness like value in hundredths, with a daily cycle for each sensor
+static int32_t value(uint32_t sensor, int64_t time) {
+    return lround(5000 + 4500 * sin(2 * M_PI * (time / (double) DAY + sensor / 97.0)));
+}
+
+static void report(const char *format, double elapsed, const Result &result, const Result &expected) {
+    printf("  %-7s %9.2f ms  %s\n", format, elapsed * 1000,
+           result.count == expected.count && result.sum == expected.sum ? "" : "WRONG RESULT");
+}
+
+// Parse a CSV file of time,sensor,value rows through mmap, as a tool without an index would
+static Result scan_csv(const std::string &path, const Query &query) {
+    Result result;
+    int fd = open(path.c_str(), O_RDONLY);
+    size_t size = file_size(path);
+    const char *data = (const char *) mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    const char *end = data + size;
+    // Skip the heading
+    const char *p = (const char *) memchr(data, '\n', size) + 1;
+    while (p < end) {
+        int64_t fields[3] = {0, 0, 0};
+        for (int64_t &field : fields) {
+            bool negative = *p == '-';
+            p += negative;
+            while (*p >= '0' && *p <= '9') {
+                field = field * 10 + (*p++ - '0');
+            }
+            field = negative ? -field : field;
+            p++;
+        }
+        if ((query.sensor == ARCHIVE_ALL_SENSORS || fields[1] == query.sensor) && fields[0] >= query.from &&
+            fields[0] < query.to) {
+            result.count++;
+            result.sum += fields[2];
+        }
+    }
+    munmap((void *) data, size);
+    close(fd);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    uint32_t sensors = argc > 1 ? strtoul(argv[1], nullptr, 0) : 200;
+    uint32_t days = argc > 2 ? strtoul(argv[2], nullptr, 0) : 30;
+    std::string directory = argc > 3 ? argv[3] : "/tmp";
+    const int64_t start = 1760000000000 / DAY * DAY;
+    const int64_t end = start + days * DAY;
+    std::string archivePath = directory + "/archive_bench.ccar";
+    std::string csvPath = directory + "/archive_bench.csv";
+    uint64_t rows = (uint64_t) sensors * (days * DAY / SAMPLE_INTERVAL);
+    printf("%u sensors, %u days, a sample a minute: %llu rows\n", sensors, days, (unsigned long long) rows);
+
+    // Write the rows as they'd arrive, a minute at a time for every sensor
+    printf("Writing:\n");
+    unlink(archivePath.c_str());
+    double elapsed = seconds([&]() {
+        ArchiveWriter writer(archivePath.c_str());
+        for (uint32_t sensor = 0; sensor < sensors; sensor++) {
+            writer.sensor("node" + std::to_string(sensor) + "/leaf/wetness", 100);
+        }
+        for (int64_t time = start; time < end; time += SAMPLE_INTERVAL) {
+            for (uint32_t sensor = 0; sensor < sensors; sensor++) {
+                writer.append(time, sensor, value(sensor, time));
+            }
+        }
+        writer.sync();
+    });
+    printf("  archive %9.2f s  %8.1f MB  %5.2f bytes per row\n", elapsed, file_size(archivePath) / 1e6,
+           (double) file_size(archivePath) / rows);
+
+    elapsed = seconds([&]() {
+        FILE *csv = fopen(csvPath.c_str(), "w");
+        fprintf(csv, "time,sensor,value\n");
+        for (int64_t time = start; time < end; time += SAMPLE_INTERVAL) {
+            for (uint32_t sensor = 0; sensor < sensors; sensor++) {
+                fprintf(csv, "%lld,%u,%d\n", (long long) time, (unsigned) sensor, (int) value(sensor, time));
+            }
+        }
+        fflush(csv);
+        fsync(fileno(csv));
+        fclose(csv);
+    });
+    printf("  csv     %9.2f s  %8.1f MB  %5.2f bytes per row\n", elapsed, file_size(csvPath) / 1e6,
+           (double) file_size(csvPath) / rows);
+
+#ifdef ARCHIVE_BENCH_SQLITE
+    std::string sqlitePath = directory + "/archive_bench.sqlite";
+    unlink(sqlitePath.c_str());
+    sqlite3 *database;
+    sqlite3_open(sqlitePath.c_str(), &database);
+    elapsed = seconds([&]() {
+        sqlite3_exec(database, "CREATE TABLE samples (time INTEGER, sensor INTEGER, value INTEGER, "
+                               "PRIMARY KEY (sensor, time)) WITHOUT ROWID; BEGIN", nullptr, nullptr, nullptr);
+        sqlite3_stmt *insert;
+        sqlite3_prepare_v2(database, "INSERT INTO samples VALUES (?, ?, ?)", -1, &insert, nullptr);
+        for (int64_t time = start; time < end; time += SAMPLE_INTERVAL) {
+            for (uint32_t sensor = 0; sensor < sensors; sensor++) {
+                sqlite3_bind_int64(insert, 1, time);
+                sqlite3_bind_int(insert, 2, sensor);
+                sqlite3_bind_int(insert, 3, value(sensor, time));
+                sqlite3_step(insert);
+                sqlite3_reset(insert);
+            }
+        }
+        sqlite3_finalize(insert);
+        sqlite3_exec(database, "COMMIT", nullptr, nullptr, nullptr);
+    });
+    printf("  sqlite  %9.2f s  %8.1f MB  %5.2f bytes per row\n", elapsed, file_size(sqlitePath) / 1e6,
+           (double) file_size(sqlitePath) / rows);
+#endif
+
+    const Query queries[] = {
+        {"one sensor, one day", sensors / 2, start + days / 2 * DAY, start + (days / 2 + 1) * DAY},
+        {"all sensors, one week", ARCHIVE_ALL_SENSORS, start + days / 2 * DAY, start + (days / 2 + 7) * DAY},
+        {"everything", ARCHIVE_ALL_SENSORS, INT64_MIN, INT64_MAX},
+    };
+    ArchiveReader reader(archivePath.c_str());
+    bool correct = reader.ok() && reader.rows() == rows;
+    for (const Query &query : queries) {
+        printf("Scanning %s:\n", query.name);
+        Result expected;
+        for (int64_t time = std::max(start, query.from); time < std::min(end, query.to); time += SAMPLE_INTERVAL) {
+            for (uint32_t sensor = 0; sensor < sensors; sensor++) {
+                if (query.sensor == ARCHIVE_ALL_SENSORS || sensor == query.sensor) {
+                    expected.count++;
+                    expected.sum += value(sensor, time);
+                }
+            }
+        }
+
+        Result result;
+        elapsed = seconds([&]() {
+            reader.scan(query.from, query.to, query.sensor, [&](int64_t, uint32_t, int32_t value) {
+                result.count++;
+                result.sum += value;
+            });
+        });
+        report("archive", elapsed, result, expected);
+        correct = correct && result.count == expected.count && result.sum == expected.sum;
+
+        elapsed = seconds([&]() { result = scan_csv(csvPath, query); });
+        report("csv", elapsed, result, expected);
+
+#ifdef ARCHIVE_BENCH_SQLITE
+        sqlite3_stmt *select;
+        sqlite3_prepare_v2(database, query.sensor == ARCHIVE_ALL_SENSORS ?
+            "SELECT count(*), sum(value) FROM samples WHERE time >= ?1 AND time < ?2" :
+            "SELECT count(*), sum(value) FROM samples WHERE sensor = ?3 AND time >= ?1 AND time < ?2", -1, &select, nullptr);
+        sqlite3_bind_int64(select, 1, query.from);
+        sqlite3_bind_int64(select, 2, query.to);
+        if (query.sensor != ARCHIVE_ALL_SENSORS) {
+            sqlite3_bind_int64(select, 3, query.sensor);
+        }
+        elapsed = seconds([&]() {
+            sqlite3_step(select);
+            result.count = sqlite3_column_int64(select, 0);
+            result.sum = sqlite3_column_int64(select, 1);
+        });
+        sqlite3_finalize(select);
+        report("sqlite", elapsed, result, expected);
+#endif
+    }
+#ifdef ARCHIVE_BENCH_SQLITE
+    sqlite3_close(database);
+#endif
+    return correct ? 0 : 1;
+}
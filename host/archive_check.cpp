@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "archive.h"
+#include "sample_history.h"
+#include "telemetry.h"
+#include "telemetry_archive.h"
+
+/*
+ * Checks `archive append` (see telemetry_archive.h) adds each sample a node sends once, however late
+ * its frames are appended and across its restarts, and exits with an error if any of them fails.
+ * `make check` builds and runs it with small blocks, so the archive's last rows are found across
+ * several of them.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// A frame with a sample every 30 s from uptime `first` to `now`, received at `received`
+struct Sent {
+    uint32_t boot;
+    uint32_t first;
+    uint32_t now;
+    int64_t received;
+};
+
+static std::vector<uint8_t> frame(const Sent &sent) {
+    StaticSampleHistory<1> history{"level", 1};
+    for (uint32_t uptime = sent.first; (int32_t) (sent.now - uptime) >= 0; uptime += 30000) {
+        int16_t value = uptime / 1000;
+        history.add(uptime, &value);
+    }
+    HistoryFrameHeader header{1, 1, sent.now, sent.boot, "tank"};
+    uint16_t size = history_frame_sample_size(1);
+    std::vector<uint8_t> bytes(HISTORY_FRAME_HEADER_SIZE + history.total() * size);
+    history_frame_write_header(bytes.data(), header);
+    for (uint32_t index = 0; index < history.total(); index++) {
+        history.write_sample(index, bytes.data() + HISTORY_FRAME_HEADER_SIZE + index * size);
+    }
+    return bytes;
+}
+
+// An archive in a temporary file
+struct Archive {
+    char path[32] = "/tmp/archive_check_XXXXXX";
+
+    Archive() { close(mkstemp(path)); }
+    ~Archive() { unlink(path); }
+
+    // Append frames as `archive append` does, returning the number of samples added
+    uint64_t append(const std::vector<Sent> &frames) {
+        TelemetryEngine engine;
+        engine.set_columns("tank", "level");
+        for (const Sent &sent : frames) {
+            std::vector<uint8_t> bytes = frame(sent);
+            engine.ingest("node", sent.received, bytes.data(), bytes.size());
+        }
+        ArchiveWriter writer(path);
+        ArchiveReader reader(path);
+        uint64_t added = 0;
+        engine.for_each([&](const TelemetrySeries &series) { added += archive_series(writer, reader, series); });
+        writer.sync();
+        return added;
+    }
+
+    // The rows of a sensor, as (time, value)
+    std::vector<std::pair<int64_t, int32_t>> rows(const char *sensor) {
+        ArchiveReader reader(path);
+        std::vector<std::pair<int64_t, int32_t>> rows;
+        int64_t id = reader.sensor(sensor);
+        if (id >= 0) {
+            reader.scan(INT64_MIN, INT64_MAX, id, [&](int64_t time, uint32_t, int32_t value) { rows.push_back({time, value}); });
+        }
+        return rows;
+    }
+};
+
+// A frame appended an hour after it was downloaded (with no -t) resumes the boot archived before
+static void late_append_skips_archived_samples() {
+    Archive archive;
+    CHECK(archive.append({{7, 0, 60000, 1000000060000}}) == 3);
+    CHECK(archive.append({{7, 0, 120000, 1000003720000}}) == 2);
+    std::vector<std::pair<int64_t, int32_t>> uptimes = archive.rows("node/tank/uptime");
+    CHECK(uptimes.size() == 5);
+    for (size_t i = 0; i < uptimes.size(); i++) {
+        CHECK(uptimes[i].first == 1000000000000 + 30000 * (int64_t) i);
+        CHECK(uptimes[i].second == 30000 * (int32_t) i);
+    }
+    CHECK(archive.rows("node/tank/boot").size() == 1);
+}
+
+// After a restart the samples from the new boot are added, even if its uptime has passed the old one
+static void restart_is_a_new_boot() {
+    Archive archive;
+    CHECK(archive.append({{7, 0, 60000, 1000000060000}}) == 3);
+    CHECK(archive.append({{8, 0, 90000, 1000000600000}}) == 4);
+    std::vector<std::pair<int64_t, int32_t>> boots = archive.rows("node/tank/boot");
+    CHECK(boots.size() == 2);
+    CHECK(boots.size() == 2 && boots[0].second == 7 && boots[1].second == 8);
+    CHECK(boots.size() == 2 && boots[1].first == 1000000510000);
+    CHECK(archive.rows("node/tank/level").size() == 7);
+}
+
+// Frames from a boot before the one archived last, and the ones archived since, add nothing
+static void earlier_boots_are_skipped() {
+    Archive archive;
+    archive.append({{7, 0, 60000, 1000000060000}});
+    archive.append({{8, 0, 90000, 1000000600000}});
+    CHECK(archive.append({{7, 0, 60000, 1000000060000}, {8, 0, 90000, 1000000600000}}) == 0);
+    CHECK(archive.append({{7, 0, 60000, 1000000060000}, {8, 0, 120000, 1000009000000}}) == 1);
+    CHECK(archive.rows("node/tank/level").size() == 8);
+}
+
+// The uptime wrapping after 49.7 days isn't a restart
+static void uptime_wraps() {
+    Archive archive;
+    CHECK(archive.append({{7, 4294890000u, 4294950000u, 1000000060000}}) == 3);
+    CHECK(archive.append({{7, 4294890000u, 42704u, 1000000120000}}) == 2);
+    std::vector<std::pair<int64_t, int32_t>> uptimes = archive.rows("node/tank/uptime");
+    CHECK(uptimes.size() == 5);
+    CHECK(uptimes.size() == 5 && uptimes[4].first - uptimes[0].first == 120000);
+}
+
+int main() {
+    static const struct {
+        const char *name;
+        void (*check)();
+    } checks[] = {
+        {"late_append_skips_archived_samples", late_append_skips_archived_samples},
+        {"restart_is_a_new_boot", restart_is_a_new_boot},
+        {"earlier_boots_are_skipped", earlier_boots_are_skipped},
+        {"uptime_wraps", uptime_wraps},
+    };
+    int failed = 0;
+    for (const auto &check : checks) {
+        int before = failures;
+        check.check();
+        printf("%s %s\n", failures == before ? "ok    " : "FAILED", check.name);
+        failed += failures != before;
+    }
+    printf("%d of %zu checks failed\n", failed, sizeof(checks) / sizeof(checks[0]));
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "LeafSens.h"
+#include "simulated_sensors.h"
+#include "triggered_sensor_reader.h"
+
+/*
+ * Runs the drivers' protocol code against simulated sensors as fast as it can, reporting the host
+ * time per measurement (the cost of the protocol code and the bus abstraction) and the simulated
+ * bus time (what each measurement would take on a real bus at the given frequency):
+ *
+ * ```
+ * bus_bench [measurements] [frequency]
+ * ```
+ */
+static void report(const char *name, long count, double seconds, const I2CBus &bus) {
+    printf("%-8s %8.0f ns per measurement, %u transactions (%u failed), bus %.3f ms per measurement, worst transaction %u us\n",
+           name, seconds * 1e9 / count, (unsigned) bus.stats.transactions, (unsigned) bus.stats.failures,
+           bus.stats.totalMicros / 1000.0 / count, (unsigned) bus.stats.worstMicros);
+}
+
+int main(int argc, char **argv) {
+    long count = argc > 1 ? strtol(argv[1], nullptr, 0) : 100000;
+    uint32_t frequency = argc > 2 ? strtoul(argv[2], nullptr, 0) : 100000;
+
+    SimulatedI2CBus sen0590Bus(frequency);
+    SimulatedSen0590 sen0590;
+    sen0590Bus.attach(Sen0590Protocol::default_address, &sen0590);
+    TriggeredSensorReader<Sen0590Protocol> reader(&sen0590Bus);
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) {
+        sen0590.set(i & 0x0FFF);
+        Sen0590Payload payload;
+        if (reader.read(payload) != I2CStatus::OK) {
+            fprintf(stderr, "sen0590 failed at %ld\n", i);
+            return 1;
+        }
+        sum += payload.distance_mm();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report("sen0590", count, elapsed.count(), sen0590Bus);
+
+    SimulatedI2CBus leafBus(frequency);
+    SimulatedLeafSensor leaf;
+    leafBus.attach(0x61, &leaf);
+    LeafSens sensor;
+    sensor.init(0x61, &leafBus);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) {
+        leaf.set(i % 10000, 2500);
+        sensor.newReading();
+        float readings[2];
+        sensor.getData(readings);
+        sum += (uint32_t) readings[0];
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    report("leaf", count, elapsed.count(), leafBus);
+
+    // Keep the results live so the loops aren't optimised away
+    return sum == 0xFFFFFFFF;
+}
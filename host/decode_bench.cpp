@@ -0,0 +1,93 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "batch_decode.h"
+#include "sen0590_protocol.h"
+
+/*
+ * Compares decoding arrays of raw payloads with batch_decode.h against decoding them a payload at a
+ * time, checking the results are identical. Both give the raw readings, before the calibration and
+ * plausibility checks the components apply:
+ *
+ * ```
+ * decode_bench [payloads] [rounds]
+ * ```
+ */
+
+// The leaf payload as the component reads it, both values little-endian like the ESP
+struct LeafPayload {
+    int16_t wetness;
+    int16_t temperature;
+};
+
+template<typename Function>
+static double time_rounds(long rounds, Function function) {
+    auto start = std::chrono::steady_clock::now();
+    for (long round = 0; round < rounds; round++) {
+        function();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 4096;
+    long rounds = argc > 2 ? strtol(argv[2], nullptr, 0) : 10000;
+#if defined(BATCH_DECODE_SSE2)
+    const char *implementation = "SSE2";
+#elif defined(BATCH_DECODE_NEON)
+    const char *implementation = "NEON";
+#else
+    const char *implementation = "scalar";
+#endif
+
+    std::vector<uint8_t> sen0590Raw(count * 2), leafRaw(count * 4);
+    srand(1);
+    for (uint8_t &byte : sen0590Raw) {
+        byte = rand();
+    }
+    for (uint8_t &byte : leafRaw) {
+        byte = rand();
+    }
+    std::vector<uint16_t> distances(count), expectedDistances(count);
+    std::vector<float> wetness(count), temperature(count), expectedWetness(count), expectedTemperature(count);
+
+    // A payload at a time, as the components read the raw readings from the payloads
+    double single = time_rounds(rounds, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            Sen0590Payload payload;
+            memcpy(&payload, &sen0590Raw[i * 2], sizeof(payload));
+            expectedDistances[i] = payload.distance_mm();
+        }
+        asm volatile("" : : "r"(expectedDistances.data()) : "memory");
+    });
+    double batch = time_rounds(rounds, [&]() {
+        sen0590_decode_batch(sen0590Raw.data(), count, distances.data());
+        asm volatile("" : : "r"(distances.data()) : "memory");
+    });
+    bool same = distances == expectedDistances;
+    printf("sen0590 %s: %.2f ns per payload one at a time, %.2f ns batched (%.1fx), %s\n", implementation,
+           single * 1e9 / (rounds * count), batch * 1e9 / (rounds * count), single / batch,
+           same ? "identical" : "DIFFERENT");
+
+    single = time_rounds(rounds, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            LeafPayload payload;
+            memcpy(&payload, &leafRaw[i * 4], sizeof(payload));
+            expectedWetness[i] = payload.wetness / 100.0f;
+            expectedTemperature[i] = payload.temperature / 100.0f;
+        }
+        asm volatile("" : : "r"(expectedWetness.data()), "r"(expectedTemperature.data()) : "memory");
+    });
+    batch = time_rounds(rounds, [&]() {
+        leaf_decode_batch(leafRaw.data(), count, wetness.data(), temperature.data());
+        asm volatile("" : : "r"(wetness.data()), "r"(temperature.data()) : "memory");
+    });
+    bool leafSame = wetness == expectedWetness && temperature == expectedTemperature;
+    printf("leaf    %s: %.2f ns per payload one at a time, %.2f ns batched (%.1fx), %s\n", implementation,
+           single * 1e9 / (rounds * count), batch * 1e9 / (rounds * count), single / batch,
+           leafSame ? "identical" : "DIFFERENT");
+    return same && leafSame ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Just enough of ESPHome to run the components' drivers on the host against a SimulatedI2CBus (see
+ * ../simulated_i2c_bus.h), for the harnesses and checks in host/. It isn't a port of ESPHome: there
+ * is no scheduler, the tool calls setup(), loop() and update() itself.
+ *
+ * Time is simulated. millis() and micros() read host_clock_us, which the tool moves on between
+ * loop() calls and which a SimulatedI2CBus given &host_clock_us moves on for each transaction. Each
+ * log line costs host_log_us_per_byte of that time (e.g. 87 us for a blocking 115200 baud UART) so
+ * logging shows in the timings, is printed if host_log_print is set, and is passed to host_log_hook
+ * if it's set. ESP_LOGV and ESP_LOGVV are compiled out, as they are at ESPHome's default log level.
+ */
+
+// The simulated time in us
+inline uint64_t host_clock_us = 0;
+// The time the device would take to send each byte of a log line, 0 if logging is free
+inline uint32_t host_log_us_per_byte = 0;
+// Whether to print the log
+inline bool host_log_print = false;
+// Called with each log line, if set, e.g. for a check to look at what was logged
+inline void (*host_log_hook)(char level, const char *tag, const char *message) = nullptr;
+
+inline uint32_t millis() { return (uint32_t) (host_clock_us / 1000); }
+inline uint32_t micros() { return (uint32_t) host_clock_us; }
+
+__attribute__((format(printf, 3, 4)))
+inline void host_log(char level, const char *tag, const char *format, ...) {
+    char message[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    // As ESPHome formats it, "[D][tag]: message\n"
+    host_clock_us += (uint64_t) host_log_us_per_byte * (length + 8 + __builtin_strlen(tag));
+    if (host_log_print) {
+        printf("%8.3f [%c][%s]: %s\n", host_clock_us / 1e6, level, tag, message);
+    }
+    if (host_log_hook != nullptr) {
+        host_log_hook(level, tag, message);
+    }
+}
+
+#define ESP_LOGE(tag, ...) host_log('E', tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) host_log('W', tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) host_log('I', tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) host_log('C', tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) host_log('D', tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) do { (void) (tag); } while (0)
+#define ESP_LOGVV(tag, ...) do { (void) (tag); } while (0)
+
+namespace esphome {
+
+namespace setup_priority {
+const float BUS = 1000.0f;
+const float DATA = 600.0f;
+const float AFTER_WIFI = 200.0f;
+}
+
+const uint32_t SCHEDULER_DONT_RUN = UINT32_MAX;
+
+class Component {
+    public:
+    virtual ~Component() {}
+    virtual void setup() {}
+    virtual void loop() {}
+    virtual void dump_config() {}
+    virtual float get_setup_priority() const { return 0.0f; }
+
+    void mark_failed() { failed = true; }
+    bool is_failed() const { return failed; }
+    void status_set_warning() { warning = true; }
+    void status_clear_warning() { warning = false; }
+    bool status_has_warning() const { return warning; }
+
+    protected:
+    bool failed = false;
+    bool warning = false;
+};
+
+class PollingComponent : public Component {
+    public:
+    PollingComponent(uint32_t updateInterval) : updateInterval(updateInterval) {}
+
+    virtual void update() = 0;
+    void set_update_interval(uint32_t interval) { updateInterval = interval; }
+    uint32_t get_update_interval() const { return updateInterval; }
+
+    protected:
+    uint32_t updateInterval;
+};
+
+namespace sensor {
+class Sensor {
+    public:
+    float state = NAN;
+    uint32_t publishes = 0; // The number of states published
+
+    void publish_state(float state) {
+        this->state = state;
+        publishes++;
+    }
+};
+}
+
+}
+
+using namespace esphome;
+using namespace esphome::sensor;
@@ -0,0 +1,271 @@
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esphome.h"
+#include "simulated_sensors.h"
+#include "sen0590.h"
+#include "tinovi_leaf_wetness.h"
+
+/*
+ * Measures what the components do to the heap over a long uptime, on a simulated bus with the
+ * ESPHome stub:
+ *
+ * ```
+ * heap_bench [days] [seed]
+ * ```
+ *
+ * A SEN0590 and a Tinovi leaf sensor are run for 30 simulated days (by default), once declared as
+ * function-local statics as their headers show and once allocated with `new` as the lambdas used to
+ * do. While they run operator new takes from a first-fit heap the size of what an ESP8266 has free
+ * once ESPHome is up, and the rest of the firmware is stood in for by buffers of up to 512 bytes
+ * allocated every second and freed after up to 10 minutes, a few KB at a time, with the odd one
+ * kept, which is what fragments a real node's heap. The churn is the same for both runs. Every
+ * simulated hour the free heap, the largest free block and the fragmentation (as the ESP8266 core's
+ * getHeapFragmentation() works it out) are sampled.
+ *
+ * The stub's Sensor doesn't allocate (ESPHome's does, for its name and callbacks, once at setup),
+ * so this measures the components' own code. It fails if they allocate after setup.
+ */
+
+// The heap, about what an ESP8266 has free with wifi and the API running
+#define HEAP_SIZE 40960
+#define HEADER_SIZE 8
+#define LOOP_INTERVAL 16000
+#define CHURN_SLOTS 16
+// The most buffers the churn keeps for good
+#define CHURN_KEPT 24
+
+// A block of the heap, followed by its bytes
+struct HeapBlock {
+    uint32_t size; // Including the header
+    uint32_t used;
+};
+
+alignas(16) static uint8_t heap[HEAP_SIZE];
+static bool heapActive = false; // Whether operator new takes from `heap`, or from malloc()
+
+static struct {
+    uint64_t allocations = 0;
+    uint64_t failures = 0; // Allocations the heap had no block for
+    uint64_t components = 0; // Allocations made while the components were running
+} heapStats;
+static bool inComponents = false;
+
+static HeapBlock *block_at(uint32_t offset) { return (HeapBlock *) (heap + offset); }
+
+static void heap_reset() {
+    *block_at(0) = {HEAP_SIZE, 0};
+    heapStats = {};
+}
+
+// Merge the free blocks following a free block into it
+static void coalesce(HeapBlock *block, uint32_t offset) {
+    while (offset + block->size < HEAP_SIZE && !block_at(offset + block->size)->used) {
+        block->size += block_at(offset + block->size)->size;
+    }
+}
+
+static void *heap_alloc(size_t size) {
+    uint32_t need = (uint32_t) ((size + HEADER_SIZE + 7) & ~(size_t) 7);
+    for (uint32_t offset = 0; offset < HEAP_SIZE; offset += block_at(offset)->size) {
+        HeapBlock *block = block_at(offset);
+        if (block->used) {
+            continue;
+        }
+        coalesce(block, offset);
+        if (block->size < need) {
+            continue;
+        }
+        if (block->size - need >= 2 * HEADER_SIZE) {
+            *block_at(offset + need) = {block->size - need, 0};
+            block->size = need;
+        }
+        block->used = 1;
+        heapStats.allocations++;
+        heapStats.components += inComponents;
+        return heap + offset + HEADER_SIZE;
+    }
+    heapStats.failures++;
+    return nullptr;
+}
+
+static void heap_free(void *pointer) {
+    HeapBlock *block = (HeapBlock *) ((uint8_t *) pointer - HEADER_SIZE);
+    block->used = 0;
+}
+
+static bool in_heap(void *pointer) { return pointer >= heap && pointer < heap + HEAP_SIZE; }
+
+void *operator new(size_t size) {
+    void *pointer = heapActive ? heap_alloc(size) : malloc(size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept {
+    if (in_heap(pointer)) {
+        heap_free(pointer);
+    } else {
+        free(pointer);
+    }
+}
+void operator delete[](void *pointer) noexcept { operator delete(pointer); }
+void operator delete(void *pointer, size_t) noexcept { operator delete(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { operator delete(pointer); }
+
+// The free heap, its largest block and how fragmented it is, 0 to 100%
+struct HeapState {
+    uint32_t free = 0;
+    uint32_t largest = 0;
+    float fragmentation = 0;
+};
+
+static HeapState heap_state() {
+    HeapState state;
+    double squares = 0;
+    for (uint32_t offset = 0; offset < HEAP_SIZE; offset += block_at(offset)->size) {
+        HeapBlock *block = block_at(offset);
+        if (!block->used) {
+            coalesce(block, offset);
+            uint32_t size = block->size - HEADER_SIZE;
+            state.free += size;
+            state.largest = std::max(state.largest, size);
+            squares += (double) size * size;
+        }
+    }
+    state.fragmentation = state.free == 0 ? 0.0f : 100.0f - 100.0f * sqrt(squares) / state.free;
+    return state;
+}
+
+// The rest of the firmware, allocating and freeing buffers
+struct Churn {
+    void *buffers[CHURN_SLOTS] = {};
+    uint64_t until[CHURN_SLOTS] = {}; // When each buffer is freed in us
+    uint32_t kept = 0;
+
+    // Allocate some long lived blocks, as other components do at setup
+    void setup(unsigned count) {
+        for (unsigned i = 0; i < count; i++) {
+            heap_alloc(32 + rand() % 481);
+        }
+    }
+
+    void second(uint64_t now) {
+        for (unsigned i = 0; i < CHURN_SLOTS; i++) {
+            if (buffers[i] != nullptr && now >= until[i]) {
+                heap_free(buffers[i]);
+                buffers[i] = nullptr;
+            }
+        }
+        unsigned slot = rand() % CHURN_SLOTS;
+        size_t size = 16 + rand() % 497;
+        if (buffers[slot] != nullptr) {
+            return;
+        }
+        if (kept < CHURN_KEPT && rand() % 1000 == 0) {
+            kept += heap_alloc(size) != nullptr;
+            return;
+        }
+        buffers[slot] = heap_alloc(size);
+        until[slot] = now + (1 + rand() % 600) * 1000000ULL;
+    }
+};
+
+// Run the components for `days` with them allocated statically or with new
+static bool run(double days, uint32_t seed, bool allocated) {
+    uint64_t end = (uint64_t) (days * 86400e6);
+    host_clock_us = 0;
+    srand(seed);
+    heap_reset();
+    heapActive = true;
+
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    bus.seed = seed == 0 ? 1 : seed;
+    bus.faults.nack = 5;
+    bus.faults.shortRead = 5;
+    SimulatedSen0590 distance;
+    distance.set(1234);
+    SimulatedLeafSensor leaf;
+    leaf.set(4200, 2150);
+    bus.attach(Sen0590Protocol::default_address, &distance);
+    bus.attach(LeafWetness::default_address, &leaf);
+
+    // Other components are set up either side of the lambda
+    Churn churn;
+    churn.setup(12);
+    HeapState before = heap_state();
+    LeafWetness *leafComponent;
+    Sen0590 *distanceComponent;
+    if (allocated) {
+        leafComponent = new LeafWetness(5000);
+        distanceComponent = new Sen0590(1000);
+    } else {
+        static LeafWetness staticLeaf(5000);
+        static Sen0590 staticDistance(1000);
+        leafComponent = &staticLeaf;
+        distanceComponent = &staticDistance;
+    }
+    uint32_t componentBytes = before.free - heap_state().free;
+    churn.setup(12);
+    leafComponent->set_bus(&bus);
+    distanceComponent->set_bus(&bus);
+    distanceComponent->set_adaptive_averaging(1, 8, 5, 15);
+    leafComponent->setup();
+    distanceComponent->setup();
+    uint64_t setupAllocations = heapStats.allocations;
+
+    HeapState worst = heap_state();
+    uint64_t nextLeaf = 5000000, nextDistance = 1000000, nextSecond = 1000000, nextSample = 3600000000ULL;
+    while (host_clock_us < end) {
+        uint64_t pass = host_clock_us;
+        inComponents = true;
+        leafComponent->loop();
+        distanceComponent->loop();
+        if (host_clock_us >= nextLeaf) {
+            leafComponent->update();
+            nextLeaf += 5000000;
+        }
+        if (host_clock_us >= nextDistance) {
+            distanceComponent->update();
+            nextDistance += 1000000;
+        }
+        inComponents = false;
+        if (host_clock_us >= nextSecond) {
+            churn.second(host_clock_us);
+            nextSecond += 1000000;
+        }
+        if (host_clock_us >= nextSample || host_clock_us >= end) {
+            HeapState state = heap_state();
+            worst.free = std::min(worst.free, state.free);
+            worst.largest = std::min(worst.largest, state.largest);
+            worst.fragmentation = std::max(worst.fragmentation, state.fragmentation);
+            nextSample += 3600000000ULL;
+        }
+        host_clock_us = std::max(host_clock_us, pass + LOOP_INTERVAL);
+    }
+    HeapState last = heap_state();
+    heapActive = false;
+
+    printf("%s: %u bytes of heap for the components, %llu allocations by them after setup, %u + %u publishes\n",
+           allocated ? "new   " : "static", (unsigned) componentBytes, (unsigned long long) heapStats.components,
+           (unsigned) leafComponent->wetness_sensor.publishes, (unsigned) distanceComponent->publishes);
+    printf("        %llu allocations (%llu at setup), %llu failed; free %u bytes (least %u), largest block %u (least %u), "
+           "fragmentation %.1f%% (worst %.1f%%)\n",
+           (unsigned long long) heapStats.allocations, (unsigned long long) setupAllocations,
+           (unsigned long long) heapStats.failures, (unsigned) last.free, (unsigned) worst.free,
+           (unsigned) last.largest, (unsigned) worst.largest, last.fragmentation, worst.fragmentation);
+    return heapStats.components == 0;
+}
+
+int main(int argc, char **argv) {
+    double days = argc > 1 ? strtod(argv[1], nullptr) : 30;
+    uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+    printf("%.1f days, a %u byte heap, seed %u\n", days, (unsigned) HEAP_SIZE, (unsigned) seed);
+    bool ok = run(days, seed, false);
+    ok = run(days, seed, true) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include "i2c_bus.h"
+
+/*
+ * An I2CBus on a Linux i2c-dev adapter (/dev/i2c-N), so the drivers' protocol code can run on a
+ * Raspberry Pi gateway, or on a development machine against the kernel's i2c-stub module:
+ *
+ * ```
+ * modprobe i2c-dev
+ * modprobe i2c-stub chip_addr=0x61,0x74
+ * ```
+ *
+ * Each transaction is a single I2C_RDWR ioctl, so write_read() keeps the bus with a repeated start.
+ *
+ * Adapters which can only do SMBus (without I2C_FUNC_I2C, like i2c-stub and some SoC controllers)
+ * get the SMBus transaction with the same bytes on the wire instead: an empty write is a quick
+ * write, writing a register (and a value) is a send byte (or write byte data), a longer write is an
+ * I2C block write, and reading a register is a read byte data or I2C block read. A read without a
+ * register is a receive byte for each byte, which relies on the device moving on to the next
+ * register after each, as i2c-stub and the sensors here do. Anything else (e.g. blocks over 32
+ * bytes) fails with ERROR.
+ *
+ * Devices which don't answer are reported as NACK (the adapters return ENXIO, EREMOTEIO or EIO
+ * depending on the driver), and any other failure as ERROR. The user needs read/write access to the
+ * device (e.g. membership of the i2c group).
+ */
+class LinuxI2CBus : public I2CBus {
+    public:
+    LinuxI2CBus(const char *device) : fd(open(device, O_RDWR)) {
+        if (fd < 0) {
+            perror(device);
+            return;
+        }
+        unsigned long functions = 0;
+        if (ioctl(fd, I2C_FUNCS, &functions) < 0) {
+            perror(device);
+        }
+        this->functions = functions;
+    }
+    LinuxI2CBus(const LinuxI2CBus &) = delete;
+    LinuxI2CBus &operator=(const LinuxI2CBus &) = delete;
+    ~LinuxI2CBus() override {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Whether the adapter was opened
+    bool ok() const { return fd >= 0; }
+    // Whether the adapter can only do SMBus transactions
+    bool smbus_only() const { return (functions & I2C_FUNC_I2C) == 0; }
+
+    void wait(uint32_t ms) override {
+        timespec time = {(time_t) (ms / 1000), (long) (ms % 1000) * 1000000L};
+        while (nanosleep(&time, &time) != 0) {
+        }
+    }
+    uint32_t micros() override {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (uint32_t) (time.tv_sec * 1000000ULL + time.tv_nsec / 1000);
+    }
+
+    protected:
+    int fd;
+    unsigned long functions = 0; // What the adapter can do (I2C_FUNC_...)
+    int target = -1; // The address SMBus transactions are sent to (I2C_SLAVE)
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        if (smbus_only()) {
+            return smbus_write(address, data, length);
+        }
+        i2c_msg message = {address, 0, (uint16_t) length, const_cast<uint8_t *>(data)};
+        return transfer(&message, 1);
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        if (smbus_only()) {
+            return smbus_read(address, data, length);
+        }
+        i2c_msg message = {address, I2C_M_RD, (uint16_t) length, data};
+        return transfer(&message, 1);
+    }
+    I2CStatus do_write_read(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) override {
+        if (smbus_only()) {
+            return smbus_read_register(address, data, length, buffer, size);
+        }
+        i2c_msg messages[2] = {
+            {address, 0, (uint16_t) length, const_cast<uint8_t *>(data)},
+            {address, I2C_M_RD, (uint16_t) size, buffer},
+        };
+        return transfer(messages, 2);
+    }
+
+    I2CStatus transfer(i2c_msg *messages, uint32_t count) {
+        if (fd < 0) {
+            return I2CStatus::ERROR;
+        }
+        i2c_rdwr_ioctl_data transaction = {messages, count};
+        return ioctl(fd, I2C_RDWR, &transaction) < 0 ? failure() : I2CStatus::OK;
+    }
+
+    // The status for a failed ioctl
+    static I2CStatus failure() {
+        // Adapters report a missing device as ENXIO, EREMOTEIO or EIO depending on the driver
+        return errno == ENXIO || errno == EREMOTEIO || errno == EIO ? I2CStatus::NACK : I2CStatus::ERROR;
+    }
+
+    I2CStatus smbus_write(uint8_t address, const uint8_t *data, size_t length) {
+        i2c_smbus_data block;
+        if (length == 0) {
+            // A quick write has the read/write bit as its data
+            return smbus(address, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, nullptr, I2C_FUNC_SMBUS_QUICK);
+        }
+        if (length == 1) {
+            return smbus(address, I2C_SMBUS_WRITE, data[0], I2C_SMBUS_BYTE, nullptr, I2C_FUNC_SMBUS_WRITE_BYTE);
+        }
+        if (length == 2) {
+            block.byte = data[1];
+            return smbus(address, I2C_SMBUS_WRITE, data[0], I2C_SMBUS_BYTE_DATA, &block, I2C_FUNC_SMBUS_WRITE_BYTE_DATA);
+        }
+        if (length - 1 > I2C_SMBUS_BLOCK_MAX) {
+            return I2CStatus::ERROR;
+        }
+        block.block[0] = length - 1;
+        memcpy(block.block + 1, data + 1, length - 1);
+        return smbus(address, I2C_SMBUS_WRITE, data[0], I2C_SMBUS_I2C_BLOCK_DATA, &block,
+                     I2C_FUNC_SMBUS_WRITE_I2C_BLOCK);
+    }
+    I2CStatus smbus_read(uint8_t address, uint8_t *data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            i2c_smbus_data byte;
+            I2CStatus status = smbus(address, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &byte, I2C_FUNC_SMBUS_READ_BYTE);
+            if (status != I2CStatus::OK) {
+                return status;
+            }
+            data[i] = byte.byte;
+        }
+        return I2CStatus::OK;
+    }
+    I2CStatus smbus_read_register(uint8_t address, const uint8_t *data, size_t length, uint8_t *buffer, size_t size) {
+        if (length != 1 || size == 0 || size > I2C_SMBUS_BLOCK_MAX) {
+            return I2CStatus::ERROR;
+        }
+        i2c_smbus_data block;
+        if (size == 1) {
+            I2CStatus status = smbus(address, I2C_SMBUS_READ, data[0], I2C_SMBUS_BYTE_DATA, &block,
+                                     I2C_FUNC_SMBUS_READ_BYTE_DATA);
+            buffer[0] = block.byte;
+            return status;
+        }
+        block.block[0] = size;
+        I2CStatus status = smbus(address, I2C_SMBUS_READ, data[0], I2C_SMBUS_I2C_BLOCK_DATA, &block,
+                                 I2C_FUNC_SMBUS_READ_I2C_BLOCK);
+        if (status == I2CStatus::OK && block.block[0] < size) {
+            status = I2CStatus::SHORT;
+        }
+        memcpy(buffer, block.block + 1, size);
+        return status;
+    }
+
+    // An SMBus transaction, if the adapter can do it (`function`)
+    I2CStatus smbus(uint8_t address, uint8_t direction, uint8_t command, uint32_t size, i2c_smbus_data *data,
+                    unsigned long function) {
+        if (fd < 0 || (functions & function) == 0) {
+            return I2CStatus::ERROR;
+        }
+        if (target != address) {
+            if (ioctl(fd, I2C_SLAVE, (unsigned long) address) < 0) {
+                // e.g. EBUSY if a kernel driver has the address
+                return I2CStatus::ERROR;
+            }
+            target = address;
+        }
+        i2c_smbus_ioctl_data transaction = {direction, command, size, data};
+        return ioctl(fd, I2C_SMBUS, &transaction) < 0 ? failure() : I2CStatus::OK;
+    }
+};
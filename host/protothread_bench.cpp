@@ -0,0 +1,183 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esphome.h"
+#include "protothread.h"
+#include "simulated_sensors.h"
+#include "sen0590.h"
+
+/*
+ * Compares the cost of driving a SEN0590 with a hand-written switch state machine (as the drivers
+ * were before protothread.h) against the same steps written as a protothread, and against the
+ * Sen0590 component itself (which also does the self-test, probing and averaging), on a simulated
+ * bus with the ESPHome stub:
+ *
+ * ```
+ * protothread_bench [measurements] [rounds]
+ * ```
+ *
+ * The main loop is simulated as a pass every 1ms with update() every 100ms, so most loop() calls
+ * are spent waiting, which is where the dispatch overhead matters. The host time per loop() call
+ * and per measurement are reported, the best of several rounds; the simulated bus and the loop
+ * around the calls are the same for all three. The bytes each keeps to resume from are reported too.
+ */
+
+#define LOOP_INTERVAL 1000
+#define UPDATE_INTERVAL 100000
+
+enum class SwitchState : uint8_t { IDLE, REQUEST, WAITING, READY, READ };
+
+// The state machine from before protothread.h, on an I2CBus, with the fixes the protothread made
+// (returning to IDLE after a read)
+class SwitchSen0590 : public PollingComponent, public Sensor {
+    public:
+    SwitchSen0590(I2CBus *bus) : PollingComponent(UPDATE_INTERVAL / 1000), bus(bus) {}
+
+    I2CBus *bus;
+    SwitchState step = SwitchState::IDLE;
+    uint32_t startRequest = 0;
+
+    void update() override { step = SwitchState::REQUEST; }
+
+    void loop() override {
+        switch (step) {
+            case SwitchState::REQUEST:
+                bus->write_register(Sen0590Protocol::default_address, Sen0590Protocol::trigger_register,
+                                    Sen0590Protocol::trigger_value);
+                step = SwitchState::WAITING;
+                startRequest = millis();
+                break;
+            case SwitchState::WAITING:
+                if (millis() - startRequest >= Sen0590Protocol::wait_period) {
+                    step = SwitchState::READY;
+                }
+                break;
+            case SwitchState::READY:
+                step = SwitchState::READ;
+                break;
+            case SwitchState::READ: {
+                Sen0590Payload payload;
+                if (bus->read_register(Sen0590Protocol::default_address, Sen0590Protocol::data_register,
+                                       (uint8_t *) &payload, sizeof(payload)) == I2CStatus::OK) {
+                    publish_state(payload.distance_mm() + 10);
+                }
+                step = SwitchState::IDLE;
+                break;
+            }
+            case SwitchState::IDLE:
+                break;
+        }
+    }
+};
+
+// The same steps as a protothread
+class ProtothreadSen0590 : public PollingComponent, public Sensor {
+    public:
+    ProtothreadSen0590(I2CBus *bus) : PollingComponent(UPDATE_INTERVAL / 1000), bus(bus) {}
+
+    I2CBus *bus;
+    Protothread thread;
+    bool requested = false;
+
+    void update() override { requested = true; }
+
+    void loop() override {
+        PT_BEGIN(thread);
+        PT_WAIT_UNTIL(thread, requested);
+        requested = false;
+        bus->write_register(Sen0590Protocol::default_address, Sen0590Protocol::trigger_register,
+                            Sen0590Protocol::trigger_value);
+        PT_WAIT_MS(thread, Sen0590Protocol::wait_period);
+        PT_YIELD(thread);
+        {
+            Sen0590Payload payload;
+            if (bus->read_register(Sen0590Protocol::default_address, Sen0590Protocol::data_register,
+                                   (uint8_t *) &payload, sizeof(payload)) == I2CStatus::OK) {
+                publish_state(payload.distance_mm() + 10);
+            }
+        }
+        PT_END(thread);
+    }
+};
+
+struct Run {
+    double seconds;
+    uint64_t calls;
+    bool correct;
+};
+
+// Run the main loop until the component has published `measurements` distances, checking they were
+// what the device measured
+template<typename Component>
+static Run drive(Component &component, SimulatedSen0590 &device, long measurements) {
+    host_clock_us = 0;
+    component.setup();
+    uint64_t nextUpdate = UPDATE_INTERVAL;
+    Run run = {0, 0, true};
+    auto start = std::chrono::steady_clock::now();
+    while (component.publishes < (uint32_t) measurements) {
+        uint32_t published = component.publishes;
+        component.loop();
+        run.calls++;
+        if (component.publishes != published) {
+            run.correct = run.correct && component.state == (float) ((published & 0x0FFF) + 10);
+            device.set((published + 1) & 0x0FFF);
+        }
+        host_clock_us += LOOP_INTERVAL;
+        if (host_clock_us >= nextUpdate) {
+            component.update();
+            nextUpdate += UPDATE_INTERVAL;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    run.seconds = elapsed.count();
+    return run;
+}
+
+// A fresh component of each kind on its own bus and device
+template<typename Component>
+static Run drive_new(long measurements) {
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    SimulatedSen0590 device;
+    bus.attach(Sen0590Protocol::default_address, &device);
+    Component component(&bus);
+    return drive(component, device, measurements);
+}
+
+// The component, set up as it would be in a lambda
+class Sen0590Component : public Sen0590 {
+    public:
+    Sen0590Component(I2CBus *bus) : Sen0590(UPDATE_INTERVAL / 1000) { set_bus(bus); }
+};
+
+int main(int argc, char **argv) {
+    long measurements = argc > 1 ? strtol(argv[1], nullptr, 0) : 100000;
+    int rounds = argc > 2 ? strtol(argv[2], nullptr, 0) : 5;
+    static const char *const names[] = {"switch", "protothread", "Sen0590"};
+    Run best[3] = {};
+    bool correct = true;
+
+    // The variants are interleaved and the fastest round of each is kept, so they see the same noise
+    for (int round = 0; round < rounds; round++) {
+        Run runs[3] = {drive_new<SwitchSen0590>(measurements), drive_new<ProtothreadSen0590>(measurements),
+                       drive_new<Sen0590Component>(measurements)};
+        for (int i = 0; i < 3; i++) {
+            correct = correct && runs[i].correct;
+            if (round == 0 || runs[i].seconds < best[i].seconds) {
+                best[i] = runs[i];
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        printf("%-12s %5.2f ns per loop() call, %6.1f ns per measurement, %.2fx the switch\n", names[i],
+               best[i].seconds * 1e9 / best[i].calls, best[i].seconds * 1e9 / measurements,
+               best[i].seconds / best[0].seconds);
+    }
+    // What each keeps to know where it's up to, besides the state the steps share
+    printf("state kept between calls: switch %zu bytes (the timer), protothread %zu bytes (the line and timer)\n",
+           sizeof(SwitchSen0590::startRequest), sizeof(ProtothreadSen0590::thread));
+    if (!correct) {
+        printf("WRONG DISTANCES published\n");
+    }
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixed_calibration.h"
+#include "linux_i2c_bus.h"
+#include "triggered_sensor_reader.h"
+#include "sen0590_protocol.h"
+#include "LeafSens.h"
+
+/*
+ * Reads a sensor through a Linux i2c-dev adapter using the same protocol code as the ESPHome
+ * components:
+ *
+ * ```
+ * read_sensor /dev/i2c-1 sen0590 [address] [count]
+ * read_sensor /dev/i2c-1 leaf [address] [count]
+ * ```
+ */
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s /dev/i2c-N sen0590|leaf [address] [count]\n", argv[0]);
+        return 2;
+    }
+    LinuxI2CBus bus(argv[1]);
+    if (!bus.ok()) {
+        return 1;
+    }
+    if (bus.smbus_only()) {
+        printf("%s can only do SMBus, using SMBus transactions\n", argv[1]);
+    }
+    bool leaf = strcmp(argv[2], "leaf") == 0;
+    if (!leaf && strcmp(argv[2], "sen0590") != 0) {
+        fprintf(stderr, "unknown sensor %s\n", argv[2]);
+        return 2;
+    }
+    uint8_t address = argc > 3 ? strtoul(argv[3], nullptr, 0) : leaf ? 0x61 : Sen0590Protocol::default_address;
+    long count = argc > 4 ? strtol(argv[4], nullptr, 0) : 1;
+
+    if (leaf) {
+        LeafSens sensor;
+        sensor.init(address, &bus);
+        for (long i = 0; i < count; i++) {
+            if (sensor.newReading() < 0) {
+                fprintf(stderr, "no answer from 0x%02X\n", address);
+                return 1;
+            }
+            float readings[2];
+            sensor.getData(readings);
+            printf("wetness %.2f %% temperature %.2f C\n", readings[0], readings[1]);
+        }
+        return 0;
+    }
+
+    TriggeredSensorReader<Sen0590Protocol> sensor(&bus, address);
+    FixedCalibration calibration(10.0f); // The same default as the component
+    for (long i = 0; i < count; i++) {
+        Sen0590Payload payload;
+        if (sensor.read(payload) != I2CStatus::OK) {
+            fprintf(stderr, "no measurement from 0x%02X\n", address);
+            return 1;
+        }
+        printf("distance %d mm\n", (int) calibration.apply(payload.distance_mm()));
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "esphome.h"
+#include "rollup_sensors.h"
+
+/*
+ * Checks the minute, hour and day rollups (see common/rollup.h) and their sensors
+ * (common/rollup_sensors.h) hand back every period which had samples, whatever the gaps between
+ * the samples, and exits with an error if any of them fails. `make check` builds and runs it.
+ */
+
+#define MINUTE 60000UL
+#define HOUR (60 * MINUTE)
+#define DAY (24 * HOUR)
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// A completed period handed back by a Rollup
+struct Completed {
+    uint8_t level;
+    RollupBucket bucket;
+};
+
+// Add a sample, returning the periods it completed
+static std::vector<Completed> add(Rollup &rollup, int32_t value, uint32_t now) {
+    std::vector<Completed> completed;
+    rollup.add(value, now, [&](uint8_t level, const RollupBucket &bucket) { completed.push_back({level, bucket}); });
+    return completed;
+}
+
+// A sample after a gap of several minutes completes the minute before the gap, which had the
+// samples, and not the empty ones in the gap
+static void minute_before_a_gap() {
+    Rollup rollup;
+    CHECK(add(rollup, 5, 0).empty());
+    CHECK(add(rollup, 7, 10000).empty());
+    std::vector<Completed> completed = add(rollup, 9, 200000);
+    CHECK(completed.size() == 1);
+    CHECK(completed[0].level == ROLLUP_MINUTE);
+    CHECK(completed[0].bucket.count == 2);
+    CHECK(completed[0].bucket.min == 5);
+    CHECK(completed[0].bucket.max == 7);
+    CHECK(completed[0].bucket.mean() == 6);
+    // The last minute completed was empty
+    CHECK(rollup.last[ROLLUP_MINUTE].count == 0);
+}
+
+// An hour and a day followed by a gap of several hours and days are handed back with their samples
+static void hour_and_day_before_a_gap() {
+    Rollup rollup;
+    std::vector<Completed> completed;
+    for (uint32_t now = 0; now < DAY; now += MINUTE) {
+        std::vector<Completed> more = add(rollup, now / HOUR, now);
+        completed.insert(completed.end(), more.begin(), more.end());
+    }
+    // Every minute but the last, and every hour but the last, of the day
+    CHECK(completed.size() == 24 * 60 - 1 + 23);
+    completed = add(rollup, 100, 3 * DAY + 5 * HOUR);
+    uint32_t levels[ROLLUP_LEVELS] = {};
+    for (const Completed &period : completed) {
+        levels[period.level]++;
+    }
+    CHECK(levels[ROLLUP_MINUTE] == 1);
+    CHECK(levels[ROLLUP_HOUR] == 1);
+    CHECK(levels[ROLLUP_DAY] == 1);
+    for (const Completed &period : completed) {
+        if (period.level == ROLLUP_HOUR) {
+            CHECK(period.bucket.count == 60);
+            CHECK(period.bucket.min == 23 && period.bucket.max == 23);
+        } else if (period.level == ROLLUP_DAY) {
+            CHECK(period.bucket.count == 24 * 60);
+            CHECK(period.bucket.min == 0 && period.bucket.max == 23);
+        }
+    }
+}
+
+// Samples taken less often than once a minute publish each minute with a sample, and the hours
+static void slow_sampling_publishes_every_minute() {
+    RollupSensors rollup;
+    Sensor minuteMean, hourMax;
+    rollup.set_sensor(ROLLUP_MINUTE, ROLLUP_MEAN, &minuteMean);
+    rollup.set_sensor(ROLLUP_HOUR, ROLLUP_MAX, &hourMax);
+    uint32_t samples = 0;
+    for (uint32_t now = 0; now <= 3 * HOUR; now += 90000) {
+        rollup.add(samples++ * 10, now, 10.0f);
+    }
+    // All the samples but the last are in minutes which have completed, one sample in each
+    CHECK(minuteMean.publishes == samples - 1);
+    CHECK(minuteMean.state == samples - 2);
+    CHECK(hourMax.publishes == 3);
+    CHECK(hourMax.state == samples - 2);
+}
+
+// A Rollup which closes each minute of a gap one at a time, as it used to
+class MinuteByMinute : public Rollup {
+    public:
+    template<typename Completed>
+    uint8_t add(int32_t value, uint32_t now, Completed completed) {
+        if (!started) {
+            started = true;
+            minuteStart = now;
+        }
+        uint8_t levels = 0;
+        while (now - minuteStart >= MINUTE) {
+            minuteStart += MINUTE;
+            levels |= close(ROLLUP_MINUTE, completed);
+        }
+        current[ROLLUP_MINUTE].add(value);
+        return levels;
+    }
+};
+
+static bool same(const RollupBucket &a, const RollupBucket &b) {
+    return a.min == b.min && a.max == b.max && a.sum == b.sum && a.count == b.count;
+}
+
+// Gaps of any length, skipped in a few steps, complete the same periods as closing every minute,
+// including across millis() wrapping
+static void long_gaps_match_closing_each_minute() {
+    srand(1);
+    Rollup rollup;
+    MinuteByMinute reference;
+    uint32_t now = (uint32_t) (0x100000000ULL - 5 * DAY);
+    for (int i = 0; i < 5000; i++) {
+        switch (rand() % 4) {
+            case 0:
+                now += rand() % MINUTE;
+                break;
+            case 1:
+                now += rand() % (3 * HOUR);
+                break;
+            case 2:
+                now += rand() % (3 * DAY);
+                break;
+            default:
+                now += (uint32_t) (rand() % 4) * DAY + (rand() % 2) * HOUR - (rand() % 2) * MINUTE;
+                break;
+        }
+        int32_t value = rand() % 2001 - 1000;
+        std::vector<Completed> skipped, closed;
+        uint8_t levels = rollup.add(value, now, [&](uint8_t level, const RollupBucket &bucket) {
+            skipped.push_back({level, bucket});
+        });
+        uint8_t referenceLevels = reference.add(value, now, [&](uint8_t level, const RollupBucket &bucket) {
+            closed.push_back({level, bucket});
+        });
+        bool matches = levels == referenceLevels && skipped.size() == closed.size();
+        for (size_t j = 0; matches && j < skipped.size(); j++) {
+            matches = skipped[j].level == closed[j].level && same(skipped[j].bucket, closed[j].bucket);
+        }
+        for (uint8_t level = 0; matches && level < ROLLUP_LEVELS; level++) {
+            matches = same(rollup.current[level], reference.current[level]) && same(rollup.last[level], reference.last[level]);
+        }
+        if (!matches) {
+            CHECK(matches);
+            printf("  at sample %d\n", i);
+            return;
+        }
+    }
+}
+
+int main() {
+    static const struct {
+        const char *name;
+        void (*check)();
+    } checks[] = {
+        {"minute_before_a_gap", minute_before_a_gap},
+        {"hour_and_day_before_a_gap", hour_and_day_before_a_gap},
+        {"slow_sampling_publishes_every_minute", slow_sampling_publishes_every_minute},
+        {"long_gaps_match_closing_each_minute", long_gaps_match_closing_each_minute},
+    };
+    int failed = 0;
+    for (const auto &check : checks) {
+        int before = failures;
+        check.check();
+        printf("%s %s\n", failures == before ? "ok    " : "FAILED", check.name);
+        failed += failures != before;
+    }
+    printf("%d of %zu checks failed\n", failed, sizeof(checks) / sizeof(checks[0]));
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <string.h>
+#include "i2c_bus.h"
+
+// A device on a SimulatedI2CBus
+class SimulatedI2CDevice {
+    public:
+    virtual ~SimulatedI2CDevice() {}
+    // The master wrote to the device at `now` us, false to NACK
+    virtual bool write(const uint8_t *data, size_t length, uint64_t now) = 0;
+    // The master read from the device, false to NACK
+    virtual bool read(uint8_t *data, size_t length, uint64_t now) = 0;
+};
+
+// Faults a SimulatedI2CBus injects into transactions, each a chance in a thousand per transaction
+struct SimulatedI2CFaults {
+    uint16_t nack = 0; // The device doesn't acknowledge
+    uint16_t shortRead = 0; // A read gets nothing back, so the master reads the pull-ups
+    uint16_t stretch = 0; // The device holds the clock low for stretchMicros
+    uint16_t timeout = 0; // The bus hangs until the master gives up after timeoutMicros
+    uint32_t stretchMicros = 0;
+    uint32_t timeoutMicros = 0;
+};
+
+/*
+ * An I2CBus with simulated devices on it, for running the protocol code on the host without
+ * hardware. Time is simulated too: wait() moves the clock on rather than sleeping, and each
+ * transaction takes as long as its bytes would on a real bus at `frequency`, so the protocol runs at
+ * full speed while the timings (and the bus stats) are what they would be on the device. The clock
+ * can be shared, e.g. with the ESPHome stub's millis() (see esphome_host/esphome.h).
+ *
+ * To see how the drivers cope with a bad bus, `faults` makes transactions fail or take longer at
+ * random (from `seed`, so a run can be repeated).
+ */
+class SimulatedI2CBus : public I2CBus {
+    public:
+    SimulatedI2CBus(uint32_t frequency = 100000, uint64_t *clock = nullptr)
+        : frequency(frequency), now(clock != nullptr ? *clock : ownClock) {}
+
+    SimulatedI2CFaults faults; // The faults to inject, none by default
+    uint32_t seed = 1; // The state of the random number generator choosing the faults
+    // Buses whose devices are connected to this one, e.g. by a multiplexer (see SimulatedTCA9548A)
+    SimulatedI2CBus *connected[8] = {};
+
+    // Put a device on the bus, replacing any at the address
+    void attach(uint8_t address, SimulatedI2CDevice *device) { devices[address & 0x7F] = device; }
+    // Take the device at an address off the bus
+    void detach(uint8_t address) { devices[address & 0x7F] = nullptr; }
+
+    void wait(uint32_t ms) override { now += (uint64_t) ms * 1000; }
+    uint32_t micros() override { return (uint32_t) now; }
+    // The simulated time in us
+    uint64_t time() const { return now; }
+
+    // The device which answers an address, on this bus or one connected to it
+    SimulatedI2CDevice *device(uint8_t address) const {
+        SimulatedI2CDevice *device = devices[address & 0x7F];
+        for (uint8_t i = 0; device == nullptr && i < 8; i++) {
+            if (connected[i] != nullptr) {
+                device = connected[i]->device(address);
+            }
+        }
+        return device;
+    }
+
+    protected:
+    SimulatedI2CDevice *devices[128] = {};
+    uint32_t frequency;
+    uint64_t ownClock = 0;
+    uint64_t &now; // The time in us
+
+    I2CStatus do_write(uint8_t address, const uint8_t *data, size_t length) override {
+        SimulatedI2CDevice *device = this->device(address);
+        clock(length);
+        I2CStatus fault = inject(false);
+        if (fault != I2CStatus::OK) {
+            return fault;
+        }
+        return device != nullptr && device->write(data, length, now) ? I2CStatus::OK : I2CStatus::NACK;
+    }
+    I2CStatus do_read(uint8_t address, uint8_t *data, size_t length) override {
+        SimulatedI2CDevice *device = this->device(address);
+        clock(length);
+        I2CStatus fault = inject(true);
+        if (fault == I2CStatus::SHORT) {
+            memset(data, 0xFF, length);
+        }
+        if (fault != I2CStatus::OK) {
+            return fault;
+        }
+        if (device == nullptr) {
+            return I2CStatus::NACK;
+        }
+        if (!device->read(data, length, now)) {
+            // Nothing drives the bus, so the master reads the pull-ups
+            memset(data, 0xFF, length);
+            return I2CStatus::SHORT;
+        }
+        return I2CStatus::OK;
+    }
+
+    // Whether something with a chance of `permille` in a thousand happens
+    bool chance(uint16_t permille) {
+        if (permille == 0) {
+            return false;
+        }
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed % 1000 < permille;
+    }
+
+    // Apply the faults to a transaction, returning how it failed or OK if it didn't
+    I2CStatus inject(bool reading) {
+        if (chance(faults.timeout)) {
+            now += faults.timeoutMicros;
+            return I2CStatus::ERROR;
+        }
+        if (chance(faults.stretch)) {
+            now += faults.stretchMicros;
+        }
+        if (chance(faults.nack)) {
+            return I2CStatus::NACK;
+        }
+        if (reading && chance(faults.shortRead)) {
+            return I2CStatus::SHORT;
+        }
+        return I2CStatus::OK;
+    }
+
+    // Move the clock on by a transaction's start, address, data and stop, 9 clocks per byte
+    void clock(size_t length) { now += ((length + 1) * 9 + 2) * 1000000ULL / frequency; }
+};
+
+/*
+ * A TCA9548A style multiplexer, attach() it to a bus at its address. Each of its channels is a bus
+ * to attach devices to, which are connected to the bus the multiplexer is on while their channel is
+ * selected (by writing the channel mask to it). The transactions are timed, and the faults
+ * injected, by the bus the multiplexer is on.
+ */
+class SimulatedTCA9548A : public SimulatedI2CDevice {
+    public:
+    SimulatedTCA9548A(SimulatedI2CBus *bus) : bus(bus) {}
+
+    SimulatedI2CBus channels[8];
+    uint8_t mask = 0; // The channels selected
+    uint32_t selections = 0; // The number of times the mask has been written
+
+    bool write(const uint8_t *data, size_t length, uint64_t) override {
+        if (length == 1) {
+            mask = data[0];
+            selections++;
+            for (uint8_t i = 0; i < 8; i++) {
+                bus->connected[i] = mask & (1 << i) ? &channels[i] : nullptr;
+            }
+        }
+        return true;
+    }
+    bool read(uint8_t *data, size_t length, uint64_t) override {
+        memset(data, mask, length);
+        return true;
+    }
+
+    protected:
+    SimulatedI2CBus *bus;
+};
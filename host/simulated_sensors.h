@@ -0,0 +1,117 @@
+#pragma once
+#include "simulated_i2c_bus.h"
+#include "sen0590_protocol.h"
+#include "LeafSens.h"
+
+/*
+ * Simulations of the sensors in this repository for a SimulatedI2CBus, set the value they'll
+ * measure with set(). They behave like the real ones as far as the drivers can tell: a measurement
+ * is only ready after the time the sensor takes, and reading it earlier gets the previous one.
+ */
+
+// A DFRobot SEN0590, see dfrobot-sen0590/sen0590_protocol.h
+class SimulatedSen0590 : public SimulatedI2CDevice {
+    public:
+    void set(uint16_t distance) { this->distance = distance; }
+
+    bool write(const uint8_t *data, size_t length, uint64_t now) override {
+        if (length == 0) {
+            return true;
+        }
+        reg = data[0];
+        if (reg == Sen0590Protocol::trigger_register && length == 2 && data[1] == Sen0590Protocol::trigger_value) {
+            ready = now + Sen0590Protocol::wait_period * 1000;
+            pending = distance;
+        }
+        return true;
+    }
+    bool read(uint8_t *data, size_t length, uint64_t now) override {
+        if (reg != Sen0590Protocol::data_register || length != 2) {
+            return false;
+        }
+        if (now >= ready) {
+            measured = pending;
+        }
+        data[0] = measured >> 8;
+        data[1] = measured & 0xFF;
+        return true;
+    }
+
+    protected:
+    uint8_t reg = 0;
+    uint16_t distance = 0;
+    uint16_t pending = 0;
+    uint16_t measured = 0xFFFF;
+    uint64_t ready = 0;
+};
+
+// A Tinovi leaf wetness sensor, see tinovi-leaf-sensor/LeafArduinoI2c/LeafSens.h. Put it on a bus
+// with attach() for it to move to the address written to REG_ADDR, as the real one does
+class SimulatedLeafSensor : public SimulatedI2CDevice {
+    public:
+    uint8_t address = 0x61; // Where it answers
+    bool movable = true; // Whether it takes a new address, false for one which ignores it
+
+    void attach(SimulatedI2CBus *bus, uint8_t address = 0x61) {
+        this->bus = bus;
+        this->address = address;
+        bus->attach(address, this);
+    }
+    // The readings in hundredths of a % and a degree
+    void set(int16_t wetness, int16_t temperature) {
+        this->wetness = wetness;
+        this->temperature = temperature;
+    }
+
+    bool write(const uint8_t *data, size_t length, uint64_t now) override {
+        if (length == 0) {
+            return true;
+        }
+        reg = data[0];
+        if (reg == REG_ADDR && length == 2 && movable && bus != nullptr) {
+            bus->detach(address);
+            address = data[1];
+            bus->attach(address, this);
+        } else if (reg == REG_READ_ST) {
+            // The library waits 200ms, the ESPHome component 300ms
+            ready = now + 100000;
+            pending[0] = wetness;
+            pending[1] = temperature;
+        }
+        return true;
+    }
+    bool read(uint8_t *data, size_t length, uint64_t now) override {
+        if (now >= ready) {
+            measured[0] = pending[0];
+            measured[1] = pending[1];
+        }
+        int16_t values[2];
+        switch (reg) {
+            case REG_DATA:
+                values[0] = measured[0];
+                values[1] = measured[1];
+                break;
+            case REG_WET:
+                values[0] = measured[0];
+                break;
+            case REG_TEMP:
+                values[0] = measured[1];
+                break;
+            default:
+                // The state register, 1 is ok
+                values[0] = 1;
+                break;
+        }
+        memcpy(data, values, length > sizeof(values) ? sizeof(values) : length);
+        return true;
+    }
+
+    protected:
+    SimulatedI2CBus *bus = nullptr;
+    uint8_t reg = 0;
+    int16_t wetness = 0;
+    int16_t temperature = 0;
+    int16_t pending[2] = {};
+    int16_t measured[2] = {};
+    uint64_t ready = 0;
+};
@@ -0,0 +1,305 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rollup.h"
+#include "sample_history.h"
+
+// The number of independently locked shards the series are spread over
+#ifndef TELEMETRY_SHARDS
+#define TELEMETRY_SHARDS 64
+#endif
+
+/*
+ * The samples of one sensor history (see common/sample_history.h) from one node, stored by column:
+ * the times, then the values of each channel in their own array, so scanning a channel only touches
+ * that channel's memory.
+ *
+ * Each channel also has a Rollup fed with exactly what the node's own rollups are fed (the value in
+ * the driver's units at the node's uptime) so the minute, hour and day statistics are the same as
+ * the node computes. The completed hours and days which had samples are kept. When the node restarts
+ * its rollups start again, as the node's do.
+ */
+struct TelemetrySeries {
+    std::string node;
+    std::string name; // The name of the history
+    std::vector<std::string> columns; // The names of the channels
+    uint16_t divisor = 1; // The values are in units of 1/divisor
+    std::vector<uint32_t> uptime; // When each sample was taken, in the node's uptime in ms
+    std::vector<int64_t> time; // When each sample was taken, in ms since the epoch
+    std::vector<std::vector<int16_t>> values; // A column for each channel
+    std::vector<Rollup> rollups; // For each channel
+    std::vector<std::vector<RollupBucket>> hours; // The completed hours of each channel
+    std::vector<std::vector<RollupBucket>> days; // The completed days of each channel
+    std::vector<uint64_t> timeAbove; // For each channel, the ms spent at or above the threshold
+    std::vector<int16_t> threshold; // For each channel, INT16_MAX if there isn't one
+
+    // The boots of the node the samples are from, in order, with the index of their first sample
+    struct Boot {
+        uint32_t id; // As sent in the frames
+        size_t first;
+    };
+    std::vector<Boot> boots;
+    bool haveLast = false; // Whether a sample has been stored since the node last started
+    uint32_t lastUptime = 0; // The uptime of the last sample stored
+
+    size_t size() const { return time.size(); }
+    float value(uint8_t channel, size_t index) const { return (float) values[channel][index] / divisor; }
+
+    // The channel with a name, or -1
+    int channel(const char *column) const {
+        for (size_t i = 0; i < columns.size(); i++) {
+            if (columns[i] == column) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // The rate of change of a channel in units per second between two times (ms since the epoch),
+    // the least squares slope of the samples, 0 if there are fewer than two
+    double rate(uint8_t channel, int64_t from, int64_t to) const {
+        const std::vector<int16_t> &column = values[channel];
+        double n = 0, sumT = 0, sumV = 0, sumTT = 0, sumTV = 0;
+        for (size_t i = first(from); i < time.size() && time[i] < to; i++) {
+            // Relative to the start so the squares don't lose precision
+            double t = (time[i] - from) / 1000.0;
+            double v = column[i];
+            n++;
+            sumT += t;
+            sumV += v;
+            sumTT += t * t;
+            sumTV += t * v;
+        }
+        double denominator = n * sumTT - sumT * sumT;
+        if (n < 2 || denominator == 0) {
+            return 0;
+        }
+        return (n * sumTV - sumT * sumV) / denominator / divisor;
+    }
+
+    // The index of the first sample at or after a time
+    size_t first(int64_t from) const {
+        return std::lower_bound(time.begin(), time.end(), from) - time.begin();
+    }
+};
+
+/*
+ * Analytics over the sample histories sent by many nodes (the binary frames served by
+ * common/history_export.h), for a gateway aggregating hundreds of them:
+ *
+ * - ingest() decodes a frame into the node's series, skipping samples already stored (the nodes
+ *   resend their whole ring buffer each time, compared by their uptime, which wraps every 49.7
+ *   days) and following restarts (when the frames' boot id changes). The samples are timed from the first frame received after the node starts and then by
+ *   its uptime, so the delay in receiving each frame doesn't move them
+ * - each series keeps its samples by column, the node's own minute, hour and day rollups, and the
+ *   time each channel spends at or above a threshold (e.g. leaf wetness duration)
+ * - rate() gives the rate of change of a channel over a period
+ *
+ * ingest() can be called from many threads at once: the series are spread over TELEMETRY_SHARDS
+ * shards, each with its own lock, so frames from different nodes are stored in parallel. The frames
+ * of a series should be ingested in the order they were sent. ingest_all() ingests a batch of
+ * frames on a pool of threads.
+ */
+class TelemetryEngine {
+    public:
+    // A frame as received from a node at `received` ms since the epoch
+    struct Frame {
+        std::string node;
+        int64_t received;
+        std::vector<uint8_t> bytes;
+    };
+
+    // Name the channels of the histories called `name` on every node (frames don't carry the names),
+    // e.g. set_columns("leaf_61", "temperature,wetness") as in the drivers' histories
+    void set_columns(const std::string &name, const char *columns) { columnNames[name] = columns; }
+    // Count the time channels with this name are at or above `threshold` (in their units), e.g. a
+    // wetness of 50%
+    void set_threshold(const char *column, float threshold) { thresholds[column] = threshold; }
+    // The longest gap between samples counted towards the time above the threshold in ms, gaps in
+    // the data count up to this
+    void set_max_gap(uint32_t ms) { maxGap = ms; }
+
+    // Decode and store a frame, false if it isn't one
+    bool ingest(const std::string &node, int64_t received, const uint8_t *bytes, size_t length) {
+        HistoryFrameHeader header;
+        if (!read_header(bytes, length, header)) {
+            return false;
+        }
+        std::string key = node + '/' + header.name;
+        Shard &shard = shards[shard_of(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::unique_ptr<TelemetrySeries> &entry = shard.series[key];
+        if (!entry) {
+            entry.reset(new TelemetrySeries());
+            create(*entry, node, header);
+        }
+        store(*entry, header, received, bytes + HISTORY_FRAME_HEADER_SIZE, length - HISTORY_FRAME_HEADER_SIZE);
+        return true;
+    }
+    bool ingest(const Frame &frame) { return ingest(frame.node, frame.received, frame.bytes.data(), frame.bytes.size()); }
+
+    // Ingest frames on `threads` threads, returning the number which were valid. Each thread takes
+    // the frames of its own shards, in order, so they don't wait for each other's locks and the
+    // frames of a series are stored in the order they're given
+    size_t ingest_all(const std::vector<Frame> &frames, unsigned threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, std::min(threads, (unsigned) TELEMETRY_SHARDS));
+        std::vector<std::vector<const Frame *>> work(threads);
+        for (const Frame &frame : frames) {
+            HistoryFrameHeader header;
+            if (read_header(frame.bytes.data(), frame.bytes.size(), header)) {
+                work[shard_of(frame.node + '/' + header.name) % threads].push_back(&frame);
+            }
+        }
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back([this, &work, t]() {
+                for (const Frame *frame : work[t]) {
+                    ingest(*frame);
+                }
+            });
+        }
+        size_t total = 0;
+        for (unsigned t = 0; t < threads; t++) {
+            pool[t].join();
+            total += work[t].size();
+        }
+        return total;
+    }
+
+    // Call `visit` with each series, which are locked while they're visited
+    void for_each(const std::function<void(const TelemetrySeries &)> &visit) const {
+        for (const Shard &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto &entry : shard.series) {
+                visit(*entry.second);
+            }
+        }
+    }
+
+    // A series, or nullptr. It mustn't be read while frames are being ingested
+    const TelemetrySeries *find(const std::string &node, const std::string &name) const {
+        std::string key = node + '/' + name;
+        const Shard &shard = shards[shard_of(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto entry = shard.series.find(key);
+        return entry == shard.series.end() ? nullptr : entry->second.get();
+    }
+
+    protected:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::map<std::string, std::unique_ptr<TelemetrySeries>> series;
+    };
+
+    Shard shards[TELEMETRY_SHARDS];
+    // Set before ingesting, so they're only read by the threads
+    std::map<std::string, std::string> columnNames;
+    std::map<std::string, float> thresholds;
+    uint32_t maxGap = 600000;
+
+    static size_t shard_of(const std::string &key) { return std::hash<std::string>()(key) % TELEMETRY_SHARDS; }
+
+    static bool read_header(const uint8_t *bytes, size_t length, HistoryFrameHeader &header) {
+        return length >= HISTORY_FRAME_HEADER_SIZE && history_frame_read_header(bytes, header) &&
+               header.channels > 0 && header.channels <= SAMPLE_HISTORY_MAX_CHANNELS;
+    }
+
+    void create(TelemetrySeries &series, const std::string &node, const HistoryFrameHeader &header) const {
+        series.node = node;
+        series.name = header.name;
+        series.divisor = header.divisor == 0 ? 1 : header.divisor;
+        series.values.resize(header.channels);
+        series.rollups.resize(header.channels);
+        series.hours.resize(header.channels);
+        series.days.resize(header.channels);
+        series.timeAbove.resize(header.channels, 0);
+        series.threshold.resize(header.channels, INT16_MAX);
+        auto names = columnNames.find(series.name);
+        if (names != columnNames.end()) {
+            std::string columns = names->second;
+            for (size_t start = 0; start <= columns.size();) {
+                size_t end = std::min(columns.find(',', start), columns.size());
+                series.columns.push_back(columns.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+        for (uint8_t i = 0; i < header.channels; i++) {
+            if (i >= series.columns.size()) {
+                series.columns.push_back("channel" + std::to_string(i));
+            }
+            auto threshold = thresholds.find(series.columns[i]);
+            if (threshold != thresholds.end()) {
+                series.threshold[i] = SampleHistory::clamp(lroundf(threshold->second * series.divisor));
+            }
+        }
+        series.columns.resize(header.channels);
+    }
+
+    void store(TelemetrySeries &series, const HistoryFrameHeader &header, int64_t received, const uint8_t *samples, size_t length) {
+        uint8_t channels = series.values.size();
+        if (header.channels != channels) {
+            return;
+        }
+        if (series.boots.empty() || header.boot != series.boots.back().id) {
+            // The node has restarted: its uptime starts again and so do its rollups, which it lost
+            // with the periods they hadn't completed
+            series.haveLast = false;
+            series.rollups.assign(channels, Rollup());
+            if (!series.boots.empty() && series.boots.back().first == series.size()) {
+                series.boots.pop_back();
+            }
+            series.boots.push_back({header.boot, series.size()});
+        }
+        uint16_t size = history_frame_sample_size(channels);
+        for (size_t offset = 0; offset + size <= length; offset += size) {
+            uint32_t uptime = history_frame_get(samples + offset, 4);
+            if (series.haveLast && (int32_t) (uptime - series.lastUptime) <= 0) {
+                // Already stored from an earlier frame
+                continue;
+            }
+            int16_t sample[SAMPLE_HISTORY_MAX_CHANNELS];
+            for (uint8_t i = 0; i < channels; i++) {
+                sample[i] = (int16_t) history_frame_get(samples + offset + 4 + 2 * i, 2);
+            }
+            // The first sample after the node starts is timed from when the frame was received, and
+            // the rest from their uptime, so their times don't move with each frame's delay
+            int64_t time = series.haveLast ? series.time.back() + (uint32_t) (uptime - series.lastUptime)
+                                           : received - (int64_t) (header.now - uptime);
+            add(series, uptime, time, sample);
+        }
+    }
+
+    void add(TelemetrySeries &series, uint32_t uptime, int64_t time, const int16_t *sample) {
+        size_t previous = series.size();
+        bool continues = series.haveLast;
+        for (uint8_t i = 0; i < series.values.size(); i++) {
+            // Time above the threshold is counted from each sample to the next
+            if (continues && series.values[i][previous - 1] >= series.threshold[i]) {
+                uint32_t gap = uptime - series.lastUptime;
+                series.timeAbove[i] += gap < maxGap ? gap : maxGap;
+            }
+            series.values[i].push_back(sample[i]);
+            // A sample after a gap can complete several periods, each is kept
+            series.rollups[i].add(sample[i], uptime, [&series, i](uint8_t level, const RollupBucket &bucket) {
+                if (level == ROLLUP_HOUR) {
+                    series.hours[i].push_back(bucket);
+                } else if (level == ROLLUP_DAY) {
+                    series.days[i].push_back(bucket);
+                }
+            });
+        }
+        series.uptime.push_back(uptime);
+        series.time.push_back(time);
+        series.haveLast = true;
+        series.lastUptime = uptime;
+    }
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "archive.h"
+#include "telemetry.h"
+
+/*
+ * Adds the samples of a TelemetrySeries to an archive (see archive.h), skipping those already in it,
+ * as `archive append` does. Each channel is a sensor called <node>/<history>/<column>, and two more
+ * keep track of the node:
+ *
+ * - <node>/<history>/uptime is the node's uptime in ms with each sample (as an int32, so it goes
+ *   negative after 24.8 days)
+ * - <node>/<history>/boot is the boot id from the frames (see common/sample_history.h), one row at
+ *   the first sample of each boot
+ *
+ * The samples resent from the boot archived last are recognised by its id and their uptime, however
+ * late the frames are appended, and timed on from the last one archived. Boots which started before
+ * it have been archived already, and later ones are new.
+ *
+ * `reader` is the archive as it was before anything was appended.
+ */
+inline uint64_t archive_series(ArchiveWriter &writer, const ArchiveReader &reader, const TelemetrySeries &series) {
+    std::string prefix = series.node + '/' + series.name + '/';
+    std::vector<uint32_t> sensors;
+    for (uint8_t channel = 0; channel < series.values.size(); channel++) {
+        sensors.push_back(writer.sensor(prefix + series.columns[channel], series.divisor));
+    }
+    uint32_t uptimeSensor = writer.sensor(prefix + "uptime");
+    uint32_t bootSensor = writer.sensor(prefix + "boot");
+
+    // The boot archived last, when its first sample was taken, and its last sample
+    int64_t bootTime = 0, lastTime = 0;
+    int32_t bootId = 0, lastValue = 0;
+    int64_t archivedBoot = reader.sensor(prefix + "boot");
+    int64_t archivedUptime = reader.sensor(prefix + "uptime");
+    bool archived = archivedBoot >= 0 && archivedUptime >= 0 && reader.last(archivedBoot, bootTime, bootId) &&
+                    reader.last(archivedUptime, lastTime, lastValue);
+    uint32_t lastUptime = lastValue;
+
+    uint64_t added = 0;
+    for (size_t b = 0; b < series.boots.size(); b++) {
+        size_t first = series.boots[b].first;
+        size_t end = b + 1 < series.boots.size() ? series.boots[b + 1].first : series.size();
+        bool same = archived && series.boots[b].id == (uint32_t) bootId;
+        if (archived && !same && first < end && series.time[first] < bootTime) {
+            continue;
+        }
+        bool started = same; // Whether the boot's row is in the archive
+        for (size_t i = first; i < end; i++) {
+            int64_t time = series.time[i];
+            if (same) {
+                if ((int32_t) (series.uptime[i] - lastUptime) <= 0) {
+                    continue;
+                }
+                time = lastTime + (uint32_t) (series.uptime[i] - lastUptime);
+            }
+            if (!started) {
+                writer.append(time, bootSensor, (int32_t) series.boots[b].id);
+                started = true;
+            }
+            for (uint8_t channel = 0; channel < series.values.size(); channel++) {
+                writer.append(time, sensors[channel], series.values[channel][i]);
+            }
+            writer.append(time, uptimeSensor, (int32_t) series.uptime[i]);
+            added += series.values.size();
+        }
+    }
+    return added;
+}
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "rollup.h"
+#include "sample_history.h"
+#include "telemetry.h"
+
+/*
+ * Simulates many nodes, each with a leaf sensor and a tank level history, sending their history
+ * frames every few minutes, and times TelemetryEngine ingesting them on one thread and on several.
+ * Some of the nodes restart part way through, some have been up so long their uptime wraps (after
+ * 49.7 days), and some lose their leaf sensor for a few hours. Each
+ * node also keeps the rollups the components would, which are compared with the engine's:
+ *
+ * ```
+ * telemetry_bench [nodes] [hours] [threads]
+ * ```
+ */
+
+// How often the sensors are sampled and the frames sent, in ms
+#define SAMPLE_INTERVAL 5000
+#define FRAME_INTERVAL (100 * SAMPLE_INTERVAL)
+// How long the leaf sensors which go missing are gone for, in ms
+#define GAP (5 * 3600000u + 20 * 60000u)
+
+// What a node keeps in RAM, which it loses when it restarts
+struct Device {
+    StaticSampleHistory<2> leaf{"temperature,wetness", 100};
+    StaticSampleHistory<1> tank{"distance", 1};
+    Rollup wetnessRollup; // As in LeafWetness
+    uint32_t sent = 0; // The number of samples of both histories sent in frames
+    uint32_t boot = (uint32_t) rand(); // The id sent in its frames
+};
+
+struct Node {
+    std::string name;
+    std::unique_ptr<Device> device{new Device()};
+    int64_t booted = 0; // When the node last started, in ms since the start of the simulation
+    // The wetness rollups the node has published
+    std::vector<RollupBucket> wetnessHours;
+    std::vector<RollupBucket> wetnessDays;
+};
+
+// A frame of all the samples a history keeps, as history_export.h sends it
+static TelemetryEngine::Frame frame(const Node &node, const char *name, const SampleHistory &history, uint32_t now, int64_t received) {
+    TelemetryEngine::Frame frame{node.name, received, {}};
+    HistoryFrameHeader header{history.channels, history.divisor, now, node.device->boot, {}};
+    snprintf(header.name, sizeof(header.name), "%s", name);
+    uint16_t size = history_frame_sample_size(history.channels);
+    frame.bytes.resize(HISTORY_FRAME_HEADER_SIZE + (history.total() - history.oldest()) * size);
+    history_frame_write_header(frame.bytes.data(), header);
+    uint8_t *sample = frame.bytes.data() + HISTORY_FRAME_HEADER_SIZE;
+    for (uint32_t index = history.oldest(); index < history.total(); index++, sample += size) {
+        history.write_sample(index, sample);
+    }
+    return frame;
+}
+
+static bool same_buckets(const std::vector<RollupBucket> &engine, const std::vector<RollupBucket> &node) {
+    if (engine.size() != node.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < engine.size(); i++) {
+        if (engine[i].min != node[i].min || engine[i].max != node[i].max || engine[i].sum != node[i].sum ||
+            engine[i].count != node[i].count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool increasing(const std::vector<int64_t> &times) {
+    return std::adjacent_find(times.begin(), times.end(), std::greater_equal<int64_t>()) == times.end();
+}
+
+static void configure(TelemetryEngine &engine) {
+    engine.set_columns("leaf", "temperature,wetness");
+    engine.set_columns("tank", "distance");
+    engine.set_threshold("wetness", 50);
+}
+
+int main(int argc, char **argv) {
+    unsigned nodes = argc > 1 ? strtoul(argv[1], nullptr, 0) : 100;
+    unsigned hours = argc > 2 ? strtoul(argv[2], nullptr, 0) : 24;
+    unsigned threads = argc > 3 ? strtoul(argv[3], nullptr, 0) : std::thread::hardware_concurrency();
+    const int64_t epoch = 1760000000000;
+
+    std::vector<std::unique_ptr<Node>> fleet;
+    for (unsigned i = 0; i < nodes; i++) {
+        fleet.emplace_back(new Node());
+        fleet.back()->name = "node" + std::to_string(i);
+    }
+
+    // Each node's wetness follows a daily cycle with its own phase, and its tank slowly empties. One
+    // node in ten restarts a third of the way through, losing the samples it hadn't sent, another's
+    // uptime wraps half way, and another loses its leaf sensor half way
+    std::vector<TelemetryEngine::Frame> frames;
+    uint64_t samples = 0;
+    unsigned restarts = 0, wraps = 0, gaps = 0;
+    const uint32_t end = hours * 3600000u;
+    const uint32_t restart = end / 3 / SAMPLE_INTERVAL * SAMPLE_INTERVAL;
+    const uint32_t gap = end / 2 / SAMPLE_INTERVAL * SAMPLE_INTERVAL;
+    for (unsigned i = 5; i < nodes; i += 10) {
+        // Sending frames on whole intervals of its uptime, as the others do
+        fleet[i]->booted = gap - (1LL << 32) / FRAME_INTERVAL * FRAME_INTERVAL;
+        wraps++;
+    }
+    for (uint32_t t = SAMPLE_INTERVAL; t <= end; t += SAMPLE_INTERVAL) {
+        for (unsigned i = 0; i < nodes; i++) {
+            Node &node = *fleet[i];
+            if (i % 10 == 3 && t == restart) {
+                node.device.reset(new Device());
+                node.booted = t;
+                restarts++;
+            }
+            Device &device = *node.device;
+            uint32_t now = (uint32_t) (t - node.booted);
+            double day = 2 * M_PI * (t / 86400000.0 + i / (double) nodes);
+            int16_t wetness = SampleHistory::clamp(lround(5000 + 4500 * sin(day)));
+            int16_t leaf[2] = {SampleHistory::clamp(lround(1500 + 800 * cos(day))), wetness};
+            int16_t tank[1] = {(int16_t) (500 + t / 60000 % 1000)};
+            if (i % 10 == 7 && t >= gap && t < gap + GAP) {
+                gaps += t == gap;
+            } else {
+                device.leaf.add(now, leaf);
+                device.wetnessRollup.add(wetness, now, [&node](uint8_t level, const RollupBucket &bucket) {
+                    if (level == ROLLUP_HOUR) {
+                        node.wetnessHours.push_back(bucket);
+                    } else if (level == ROLLUP_DAY) {
+                        node.wetnessDays.push_back(bucket);
+                    }
+                });
+            }
+            device.tank.add(now, tank);
+            if ((t - node.booted) % FRAME_INTERVAL == 0 || t == end) {
+                samples += device.leaf.total() + device.tank.total() - device.sent;
+                device.sent = device.leaf.total() + device.tank.total();
+                frames.push_back(frame(node, "leaf", device.leaf, now, epoch + t));
+                frames.push_back(frame(node, "tank", device.tank, now, epoch + t));
+            }
+        }
+    }
+    size_t bytes = 0;
+    for (const TelemetryEngine::Frame &frame : frames) {
+        bytes += frame.bytes.size();
+    }
+    printf("%u nodes, %u hours, %u restarts, %u wraps, %u gaps: %zu frames, %.1f MB, %llu new samples\n", nodes,
+           hours, restarts, wraps, gaps, frames.size(), bytes / 1e6, (unsigned long long) samples);
+
+    // The first run is untimed as it's slowed down by the kernel giving the process its memory
+    std::unique_ptr<TelemetryEngine> engine(new TelemetryEngine());
+    engine->ingest_all(frames, threads);
+    for (unsigned pool : {1u, threads}) {
+        engine.reset();
+        engine.reset(new TelemetryEngine());
+        configure(*engine);
+        auto start = std::chrono::steady_clock::now();
+        size_t valid = engine->ingest_all(frames, pool);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%2u threads: %zu frames in %.3f s, %.0f frames/s, %.1f M samples/s\n", pool, valid,
+               elapsed.count(), valid / elapsed.count(), samples / elapsed.count() / 1e6);
+    }
+
+    // The engine's rollups are the nodes', and each sample was stored once, in order
+    bool same = true, ordered = true;
+    size_t stored = 0;
+    for (const std::unique_ptr<Node> &node : fleet) {
+        const TelemetrySeries *leaf = engine->find(node->name, "leaf");
+        const TelemetrySeries *tank = engine->find(node->name, "tank");
+        int wetness = leaf->channel("wetness");
+        stored += leaf->size() + tank->size();
+        same = same && same_buckets(leaf->hours[wetness], node->wetnessHours) &&
+               same_buckets(leaf->days[wetness], node->wetnessDays);
+        ordered = ordered && increasing(leaf->time) && increasing(tank->time);
+    }
+    printf("%zu samples stored %s, hourly and daily rollups %s the nodes'\n", stored, ordered ? "in order" : "OUT OF ORDER",
+           same ? "identical to" : "DIFFERENT from");
+
+    const TelemetrySeries *leaf = engine->find("node0", "leaf");
+    const TelemetrySeries *tank = engine->find("node0", "tank");
+    int64_t last = tank->time.back();
+    printf("node0: wet for %.1f h, last hour mean wetness %.2f%%, tank distance changing %.3f mm/min\n",
+           leaf->timeAbove[leaf->channel("wetness")] / 3600000.0,
+           leaf->hours[leaf->channel("wetness")].empty() ? NAN : leaf->hours[leaf->channel("wetness")].back().mean() / 100.0f,
+           tank->rate(0, last - 3600000, last + 1) * 60);
+    return same && ordered && stored == samples ? 0 : 1;
+}
@@ -0,0 +1,556 @@
+#include <algorithm>
+#include <functional>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "esphome.h"
+#include "simulated_sensors.h"
+#include "acquisition_clock.h"
+#include "sen0590.h"
+#include "tca9548a_bus.h"
+// Included twice, as they are when a configuration lists them and the provisioner includes them
+#include "tinovi_leaf_wetness.h"
+#include "tinovi_leaf_provisioner.h"
+#include "tinovi_leaf_wetness.h"
+
+/*
+ * Checks the behaviour of TriggeredI2CSensor (see common/triggered_i2c_sensor.h) through the
+ * Sen0590 component, of the buses the components can be given, and of the leaf sensor provisioner,
+ * on a simulated bus with the ESPHome stub, and exits with an error if any of them fails:
+ *
+ * ```
+ * triggered_sensor_check [-v]
+ * ```
+ *
+ * -v prints the components' log. `make check` builds and runs it.
+ */
+
+#define LOOP_INTERVAL 16
+#define UPDATE_INTERVAL 1000
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// A SEN0590 which records what the component asks of it
+class RecordingSen0590 : public SimulatedSen0590 {
+    public:
+    std::vector<uint64_t> triggers; // When each measurement was started in us
+    uint32_t probes = 0; // The number of empty writes
+    std::function<void()> probed; // Called on each probe, if set
+
+    bool write(const uint8_t *data, size_t length, uint64_t now) override {
+        if (length == 0) {
+            probes++;
+            if (probed) {
+                probed();
+            }
+        } else if (data[0] == Sen0590Protocol::trigger_register) {
+            triggers.push_back(now);
+        }
+        return SimulatedSen0590::write(data, length, now);
+    }
+};
+
+// An I2CScheduler which tells whether a device is waiting for the bus
+class InspectableScheduler : public I2CScheduler {
+    public:
+    using I2CScheduler::I2CScheduler;
+
+    bool pending(int8_t id) const { return devices[id].pending; }
+};
+
+// A Sen0590 on a simulated bus, with the main loop and the update interval run by the check
+struct Node {
+    SimulatedI2CBus bus{100000, &host_clock_us};
+    RecordingSen0590 device;
+    Sen0590 sensor{UPDATE_INTERVAL};
+    uint64_t nextUpdate = UPDATE_INTERVAL * 1000;
+    I2CScheduler *scheduler = nullptr; // Started on each pass, if the sensor has one
+    std::function<void()> other; // Another component run on each pass, before or after the sensor
+
+    Node(bool plugged = true) {
+        host_clock_us = 0;
+        device.set(1000);
+        if (plugged) {
+            bus.attach(Sen0590Protocol::default_address, &device);
+        }
+        sensor.set_bus(&bus);
+        sensor.setup();
+    }
+
+    void plug() { bus.attach(Sen0590Protocol::default_address, &device); }
+    void unplug() { bus.detach(Sen0590Protocol::default_address); }
+
+    // Run a pass of the main loop, then wait for the next one
+    void pass() {
+        uint64_t start = host_clock_us;
+        if (scheduler != nullptr) {
+            scheduler->loop();
+        }
+        // ESPHome runs the components in the order they were registered, so either may be first
+        bool otherFirst = other && rand() % 2 == 0;
+        if (otherFirst) {
+            other();
+        }
+        sensor.loop();
+        if (other && !otherFirst) {
+            other();
+        }
+        if (host_clock_us >= nextUpdate) {
+            sensor.update();
+            nextUpdate += sensor.get_update_interval() * 1000ULL;
+        }
+        host_clock_us = std::max<uint64_t>(host_clock_us, start + LOOP_INTERVAL * 1000);
+    }
+    // Run the main loop for `ms`
+    void run(uint32_t ms) {
+        uint64_t end = host_clock_us + ms * 1000ULL;
+        while (host_clock_us < end) {
+            pass();
+        }
+    }
+    // Run the main loop until `condition` holds, for at most `ms`, returning whether it held
+    bool run_until(std::function<bool()> condition, uint32_t ms) {
+        uint64_t end = host_clock_us + ms * 1000ULL;
+        while (host_clock_us < end) {
+            if (condition()) {
+                return true;
+            }
+            pass();
+        }
+        return condition();
+    }
+};
+
+// A sensor which is there and working passes its self-test straight away and publishes
+static void self_test_passes() {
+    Node node;
+    CHECK(node.sensor.status_has_warning());
+    CHECK(node.run_until([&]() { return node.sensor.online; }, 200));
+    CHECK(!node.sensor.status_has_warning());
+    CHECK(node.sensor.publishes == 1);
+    CHECK(node.sensor.state == 1010.0f);
+    CHECK(node.sensor.backoff == 0);
+    node.run(10000);
+    CHECK(node.sensor.publishes >= 10);
+}
+
+// A sensor which isn't there stays offline with a warning, doesn't take measurements when asked,
+// and only has its address probed, every couple of seconds
+static void missing_sensor_is_probed() {
+    Node node(false);
+    node.run(60000);
+    CHECK(!node.sensor.online);
+    CHECK(node.sensor.status_has_warning());
+    CHECK(!node.sensor.is_failed());
+    CHECK(node.sensor.step == TriggeredSensorState::OFFLINE);
+    CHECK(node.sensor.publishes == 0);
+    CHECK(node.bus.stats.transactions >= 60000 / TRIGGERED_SENSOR_PROBE_INTERVAL - 1);
+    CHECK(node.bus.stats.transactions <= 60000 / TRIGGERED_SENSOR_PROBE_INTERVAL + 1);
+    CHECK(node.bus.stats.transactions == node.bus.stats.failures);
+}
+
+// A sensor which answers but sends implausible measurements fails its self-test, and it's retried
+// after a backoff which doubles from TRIGGERED_SENSOR_RETRY_MIN up to TRIGGERED_SENSOR_RETRY_MAX
+static void failed_self_test_backs_off() {
+    Node node;
+    node.device.set(0xFFFF);
+    node.run(30 * 60000);
+    CHECK(!node.sensor.online);
+    CHECK(node.sensor.status_has_warning());
+    CHECK(node.sensor.publishes == 0);
+    CHECK(node.sensor.backoff == TRIGGERED_SENSOR_RETRY_MAX);
+
+    // 5, 10, 20, 40, 80, 160, then 300s between the attempts, give or take a pass and the
+    // measurement
+    const std::vector<uint64_t> &triggers = node.device.triggers;
+    CHECK(triggers.size() > 8);
+    uint64_t expected = TRIGGERED_SENSOR_RETRY_MIN;
+    for (size_t i = 1; i < triggers.size(); i++) {
+        uint64_t interval = (triggers[i] - triggers[i - 1]) / 1000;
+        if (interval < expected || interval > expected + Sen0590Protocol::wait_period + 3 * LOOP_INTERVAL) {
+            printf("  attempt %zu came %llu ms after the last, expected %llu ms\n", i,
+                   (unsigned long long) interval, (unsigned long long) expected);
+            failures++;
+        }
+        expected = std::min<uint64_t>(expected * 2, TRIGGERED_SENSOR_RETRY_MAX);
+    }
+
+    // Once it measures properly it comes online at the next attempt and the backoff is reset
+    node.device.set(1000);
+    CHECK(node.run_until([&]() { return node.sensor.online; }, TRIGGERED_SENSOR_RETRY_MAX + 1000));
+    CHECK(!node.sensor.status_has_warning());
+    CHECK(node.sensor.backoff == 0);
+    CHECK(node.sensor.publishes == 1);
+}
+
+// An online sensor is only taken offline after TRIGGERED_SENSOR_MAX_FAILURES measurements in a row
+// have failed
+static void failures_in_a_row_take_it_offline() {
+    Node node;
+    CHECK(node.run_until([&]() { return node.sensor.online; }, 200));
+    // One short of the limit, then a good measurement resets the count
+    node.device.set(0xFFFF);
+    CHECK(node.run_until([&]() { return node.sensor.failures == TRIGGERED_SENSOR_MAX_FAILURES - 1; }, 10000));
+    CHECK(node.sensor.online);
+    CHECK(!node.sensor.status_has_warning());
+    node.device.set(1000);
+    uint32_t publishes = node.sensor.publishes;
+    CHECK(node.run_until([&]() { return node.sensor.publishes > publishes; }, 2000));
+    CHECK(node.sensor.failures == 0);
+
+    node.device.set(0xFFFF);
+    CHECK(node.run_until([&]() { return !node.sensor.online; }, 10000));
+    CHECK(node.sensor.status_has_warning());
+    // It's still there, so it's tried again straight away and then backs off
+    CHECK(node.sensor.failures == 0);
+    node.run(1000);
+    CHECK(node.sensor.backoff == TRIGGERED_SENSOR_RETRY_MIN);
+}
+
+// A sensor which is unplugged goes offline and stops using the bus except to probe its address,
+// and when it's plugged back in it runs its self-test and is re-initialised
+static void unplugged_sensor_comes_back() {
+    Node node;
+    // Average a few measurements, so there's state for attached() to reset
+    node.sensor.set_adaptive_averaging(4, 4, 0, 0xFFFF);
+    CHECK(node.run_until([&]() { return node.sensor.online; }, 200));
+    CHECK(node.run_until([&]() { return node.sensor.samples == 2; }, 2000));
+
+    node.unplug();
+    CHECK(node.run_until([&]() { return !node.sensor.online; },
+                         TRIGGERED_SENSOR_MAX_FAILURES * TRIGGERED_SENSOR_PROBE_INTERVAL + 1000));
+    CHECK(node.sensor.status_has_warning());
+    // While it's gone it isn't measured, and its address is only probed every couple of seconds
+    uint32_t publishes = node.sensor.publishes;
+    size_t triggers = node.device.triggers.size();
+    uint32_t transactions = node.bus.stats.transactions;
+    node.run(60000);
+    CHECK(node.sensor.step == TriggeredSensorState::OFFLINE);
+    CHECK(node.sensor.publishes == publishes);
+    CHECK(node.device.triggers.size() == triggers);
+    CHECK(node.bus.stats.transactions - transactions <= 60000 / TRIGGERED_SENSOR_PROBE_INTERVAL + 1);
+    // A sensor which isn't there doesn't back off, so it's found as soon as it's back
+    CHECK(node.sensor.backoff == 0);
+
+    // A replacement pointing at something else
+    node.device.set(2000);
+    node.plug();
+    CHECK(node.run_until([&]() { return node.sensor.online; },
+                         TRIGGERED_SENSOR_PROBE_INTERVAL + Sen0590Protocol::wait_period + 100));
+    CHECK(!node.sensor.status_has_warning());
+    // The averaging was started again, so the first distance isn't mixed with the old sensor's
+    CHECK(node.run_until([&]() { return node.sensor.publishes > publishes; }, 2000));
+    CHECK(node.sensor.state == 2010.0f);
+}
+
+// A failed measurement starts the averaging window again, so the next distance isn't an average
+// of measurements from either side of the failure
+static void failed_measurement_restarts_the_average() {
+    Node node;
+    node.sensor.set_adaptive_averaging(4, 4, 0, 0xFFFF);
+    CHECK(node.run_until([&]() { return node.sensor.online; }, 200));
+    CHECK(node.run_until([&]() { return node.sensor.samples == 2; }, 2000));
+
+    node.device.set(0xFFFF);
+    CHECK(node.run_until([&]() { return node.sensor.failures == 1; }, 2000));
+    CHECK(node.sensor.online);
+    CHECK(node.sensor.samples == 0 && node.sensor.pairs == 0 && !node.sensor.haveLast);
+    node.device.set(3000);
+    uint32_t publishes = node.sensor.publishes;
+    CHECK(node.run_until([&]() { return node.sensor.publishes > publishes; }, 3000));
+    CHECK(node.sensor.state == 3010.0f);
+}
+
+// Calibration coefficients which don't fit the fixed point are ignored, and converting them clamps
+static void out_of_range_calibration_is_ignored() {
+    Node node;
+    node.sensor.set_calibration(-5.0f, 2.0f);
+    node.sensor.set_calibration(40000.0f);
+    node.sensor.set_calibration(0.0f, 1.0f, 0.5f);
+    CHECK(node.run_until([&]() { return node.sensor.publishes > 0; }, 2000));
+    CHECK(node.sensor.state == 1995.0f);
+
+    CHECK(FixedCalibration::fits(-32767.0f, 32767.0f, 0.49f));
+    CHECK(!FixedCalibration::fits(0.0f, 1.0f, NAN));
+    CHECK(FixedCalibration(1e6f, -1e6f, 0.5f).offset == INT32_MAX);
+    CHECK(FixedCalibration(1e6f, -1e6f, 0.5f).scale == INT32_MIN);
+    CHECK(FixedCalibration(1e6f, -1e6f, 0.5f).quadratic == INT32_MAX);
+    CHECK(FixedCalibration(NAN).offset == 0);
+}
+
+// A component counting its updates
+class CountingComponent : public PollingComponent {
+    public:
+    CountingComponent() : PollingComponent(1000) {}
+    uint32_t updates = 0;
+    void update() override { updates++; }
+};
+
+// The acquisition clock updates each component every `divisor` ticks, refuses a divisor of 0 and
+// skips components which have failed
+static void acquisition_clock_skips_failed_components() {
+    AcquisitionClock clock(1000);
+    CountingComponent every, fifth, failed, never;
+    CHECK(clock.add(&every));
+    CHECK(clock.add(&fifth, 5));
+    CHECK(clock.add(&failed));
+    CHECK(!clock.add(&never, 0));
+    CHECK(every.get_update_interval() == SCHEDULER_DONT_RUN);
+    CHECK(never.get_update_interval() == 1000);
+    failed.mark_failed();
+    for (int i = 0; i < 10; i++) {
+        clock.update();
+    }
+    CHECK(every.updates == 10);
+    CHECK(fifth.updates == 2);
+    CHECK(failed.updates == 0);
+    CHECK(never.updates == 0);
+}
+
+// Probes are background work, so they never take a shared bus while another component's
+// transaction is waiting for it, whether the sensor is online or has been unplugged
+static void probes_wait_for_the_idle_bus() {
+    for (bool plugged : {true, false}) {
+        Node node;
+        InspectableScheduler scheduler(60000);
+        node.scheduler = &scheduler;
+        // Measuring less often than it's probed, so it's probed while it's online
+        node.sensor.set_update_interval(10000);
+        // The sensor has the higher priority, so only its measurements go before the other device
+        node.sensor.set_scheduler(&scheduler, 10, 20);
+        int8_t otherId = scheduler.add("other", 1, 500);
+        // Another device which wants the bus on about a third of the passes
+        bool wants = false;
+        node.other = [&]() {
+            wants = wants || rand() % 3 == 0;
+            if (wants && scheduler.acquire(otherId)) {
+                uint8_t data[2] = {0x00, 0x00};
+                node.bus.write(0x10, data, sizeof(data));
+                scheduler.release(otherId);
+                wants = false;
+            }
+        };
+        uint32_t contended = 0;
+        node.device.probed = [&]() { contended += scheduler.pending(otherId); };
+        CHECK(node.run_until([&]() { return node.sensor.online; }, 1000));
+        if (!plugged) {
+            node.unplug();
+            CHECK(node.run_until([&]() { return !node.sensor.online; }, 10000));
+        }
+        uint32_t probes = node.device.probes;
+        node.run(10 * 60000);
+        CHECK(contended == 0);
+        // They still get through, as the bus is often idle
+        if (plugged) {
+            CHECK(node.device.probes > probes);
+        } else {
+            CHECK(node.bus.stats.failures >= 10 * 60000 / TRIGGERED_SENSOR_PROBE_INTERVAL / 2);
+        }
+    }
+}
+
+// Sensors with the same address on different channels of a multiplexer are each measured on their
+// own channel, and one going missing doesn't affect the other
+static void sensors_behind_a_multiplexer() {
+    host_clock_us = 0;
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    SimulatedTCA9548A simulatedMultiplexer(&bus);
+    SimulatedSen0590 near, far;
+    near.set(1000);
+    far.set(2000);
+    simulatedMultiplexer.channels[2].attach(Sen0590Protocol::default_address, &near);
+    simulatedMultiplexer.channels[5].attach(Sen0590Protocol::default_address, &far);
+    bus.attach(0x70, &simulatedMultiplexer);
+
+    TCA9548A multiplexer(&bus, 0x70);
+    TCA9548AChannel channel2(&multiplexer, 2), channel5(&multiplexer, 5);
+    Sen0590 nearSensor(UPDATE_INTERVAL), farSensor(UPDATE_INTERVAL);
+    nearSensor.set_bus(&channel2);
+    farSensor.set_bus(&channel5);
+    nearSensor.setup();
+    farSensor.setup();
+    uint64_t nextUpdate = UPDATE_INTERVAL * 1000;
+    auto run = [&](uint32_t ms) {
+        uint64_t end = host_clock_us + ms * 1000ULL;
+        while (host_clock_us < end) {
+            uint64_t start = host_clock_us;
+            nearSensor.loop();
+            farSensor.loop();
+            if (host_clock_us >= nextUpdate) {
+                nearSensor.update();
+                farSensor.update();
+                nextUpdate += UPDATE_INTERVAL * 1000;
+            }
+            host_clock_us = std::max<uint64_t>(host_clock_us, start + LOOP_INTERVAL * 1000);
+        }
+    };
+    run(10000);
+    CHECK(nearSensor.online && farSensor.online);
+    CHECK(nearSensor.state == 1010.0f);
+    CHECK(farSensor.state == 2010.0f);
+    CHECK(nearSensor.publishes >= 10 && farSensor.publishes >= 10);
+    // The channel is only selected when a transaction is on the other one
+    CHECK(simulatedMultiplexer.selections < channel2.stats.transactions + channel5.stats.transactions);
+
+    simulatedMultiplexer.channels[5].detach(Sen0590Protocol::default_address);
+    uint32_t publishes = nearSensor.publishes;
+    run(10000);
+    CHECK(!farSensor.online);
+    CHECK(nearSensor.online);
+    CHECK(nearSensor.failures == 0);
+    CHECK(nearSensor.publishes >= publishes + 9);
+}
+
+// The lines logged since the last clear(), for the checks to look for
+static std::vector<std::string> logged;
+
+static void log_line(char, const char *, const char *message) { logged.push_back(message); }
+
+static bool was_logged(const char *line) { return std::find(logged.begin(), logged.end(), line) != logged.end(); }
+
+// Run a provisioner on a simulated bus for a while
+static void run_provisioner(LeafWetnessProvisioner &provisioner, uint32_t ms) {
+    uint64_t end = host_clock_us + ms * 1000ULL;
+    while (host_clock_us < end) {
+        uint64_t start = host_clock_us;
+        provisioner.loop();
+        host_clock_us = std::max<uint64_t>(host_clock_us, start + LOOP_INTERVAL * 1000);
+    }
+}
+
+// Sensors connected one at a time are each moved to the next address which doesn't answer, and
+// the whole custom sensor reading them is logged after each one
+static void provisioner_moves_sensors_one_at_a_time() {
+    host_clock_us = 0;
+    logged.clear();
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    SimulatedLeafSensor first, second, taken;
+    taken.attach(&bus, 0x62);
+    first.attach(&bus);
+    LeafWetnessProvisioner provisioner(0x62);
+    provisioner.set_bus(&bus);
+    provisioner.setup();
+    run_provisioner(provisioner, 2000);
+    CHECK(!provisioner.is_failed());
+    CHECK(first.address == 0x63);
+    CHECK(bus.device(0x63) == &first);
+    CHECK(bus.device(LeafWetness::default_address) == nullptr);
+    CHECK(provisioner.count == 1);
+
+    second.attach(&bus);
+    run_provisioner(provisioner, 2000);
+    CHECK(second.address == 0x64);
+    CHECK(bus.device(LeafWetness::default_address) == nullptr);
+    CHECK(provisioner.count == 2);
+    CHECK(provisioner.provisioned[0] == 0x63 && provisioner.provisioned[1] == 0x64);
+    CHECK(provisioner.channels[0] == -1 && provisioner.channels[1] == -1);
+    CHECK(was_logged("Moved the sensor at 0x61 to 0x64"));
+    CHECK(was_logged("2 sensors provisioned, replace the provisioner's sensor with:"));
+    CHECK(was_logged("      static LeafWetness leaf_64(5000, 0x64);"));
+    CHECK(was_logged("      App.register_component(&leaf_64);"));
+    CHECK(was_logged("      return {"));
+    CHECK(was_logged("        &leaf_63.temperature_sensor, &leaf_63.wetness_sensor,"));
+    CHECK(was_logged("        &leaf_64.temperature_sensor, &leaf_64.wetness_sensor,"));
+    CHECK(was_logged("      };"));
+    CHECK(was_logged("      - name: \"Leaf 64 Temperature\""));
+    CHECK(was_logged("      - name: \"Leaf 64 Wetness\""));
+    CHECK(std::none_of(logged.begin(), logged.end(), [](const std::string &line) { return line.find("mux") != std::string::npos; }));
+    // The sensors are logged in the lambda in the order they were moved
+    CHECK(std::find(logged.rbegin(), logged.rend(), "        &leaf_63.temperature_sensor, &leaf_63.wetness_sensor,") >
+          std::find(logged.rbegin(), logged.rend(), "        &leaf_64.temperature_sensor, &leaf_64.wetness_sensor,"));
+}
+
+// A sensor which is still at 0x61 after being given a new address is reported and left out of the
+// configuration, and is tried again
+static void provisioner_reports_a_sensor_which_did_not_move() {
+    host_clock_us = 0;
+    logged.clear();
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    SimulatedLeafSensor sensor;
+    sensor.movable = false;
+    sensor.attach(&bus);
+    LeafWetnessProvisioner provisioner(0x62);
+    provisioner.set_bus(&bus);
+    provisioner.setup();
+    run_provisioner(provisioner, 2500);
+    CHECK(provisioner.count == 0);
+    CHECK(sensor.address == LeafWetness::default_address);
+    CHECK(std::count(logged.begin(), logged.end(), "The sensor at 0x61 didn't move to 0x62") == 2);
+    CHECK(!was_logged("      return {"));
+}
+
+// Behind a multiplexer each channel is checked in turn, and the sensors are put on their channels
+// in the configuration
+static void provisioner_checks_each_multiplexer_channel() {
+    host_clock_us = 0;
+    logged.clear();
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    SimulatedTCA9548A simulatedMultiplexer(&bus);
+    bus.attach(0x70, &simulatedMultiplexer);
+    SimulatedLeafSensor near, far;
+    near.attach(&simulatedMultiplexer.channels[1]);
+    far.attach(&simulatedMultiplexer.channels[6]);
+    LeafWetnessProvisioner provisioner(0x62);
+    provisioner.set_bus(&bus);
+    provisioner.set_multiplexer(0x70);
+    provisioner.setup();
+    run_provisioner(provisioner, 8 * LEAF_PROVISIONER_INTERVAL + 500);
+    CHECK(near.address == 0x62 && far.address == 0x63);
+    CHECK(simulatedMultiplexer.channels[1].device(0x62) == &near);
+    CHECK(simulatedMultiplexer.channels[6].device(0x63) == &far);
+    CHECK(provisioner.count == 2);
+    CHECK(provisioner.channels[0] == 1 && provisioner.channels[1] == 6);
+    CHECK(was_logged("Moved the sensor at 0x61 on channel 6 to 0x63"));
+    CHECK(was_logged("      static TCA9548A mux(wire_bus(), 0x70);"));
+    CHECK(was_logged("      static TCA9548AChannel mux_1(&mux, 1);"));
+    CHECK(was_logged("      static TCA9548AChannel mux_6(&mux, 6);"));
+    CHECK(was_logged("      leaf_62.set_bus(&mux_1);"));
+    CHECK(was_logged("      leaf_63.set_bus(&mux_6);"));
+    CHECK(was_logged("        &leaf_63.temperature_sensor, &leaf_63.wetness_sensor,"));
+
+    // They stay where they are on the next pass
+    run_provisioner(provisioner, 8 * LEAF_PROVISIONER_INTERVAL);
+    CHECK(provisioner.count == 2);
+}
+
+int main(int argc, char **argv) {
+    host_log_print = argc > 1 && strcmp(argv[1], "-v") == 0;
+    host_log_hook = log_line;
+    static const struct {
+        const char *name;
+        void (*check)();
+    } checks[] = {
+        {"self_test_passes", self_test_passes},
+        {"missing_sensor_is_probed", missing_sensor_is_probed},
+        {"failed_self_test_backs_off", failed_self_test_backs_off},
+        {"failures_in_a_row_take_it_offline", failures_in_a_row_take_it_offline},
+        {"unplugged_sensor_comes_back", unplugged_sensor_comes_back},
+        {"failed_measurement_restarts_the_average", failed_measurement_restarts_the_average},
+        {"out_of_range_calibration_is_ignored", out_of_range_calibration_is_ignored},
+        {"acquisition_clock_skips_failed_components", acquisition_clock_skips_failed_components},
+        {"probes_wait_for_the_idle_bus", probes_wait_for_the_idle_bus},
+        {"sensors_behind_a_multiplexer", sensors_behind_a_multiplexer},
+        {"provisioner_moves_sensors_one_at_a_time", provisioner_moves_sensors_one_at_a_time},
+        {"provisioner_reports_a_sensor_which_did_not_move", provisioner_reports_a_sensor_which_did_not_move},
+        {"provisioner_checks_each_multiplexer_channel", provisioner_checks_each_multiplexer_channel},
+    };
+    int failed = 0;
+    for (const auto &check : checks) {
+        int before = failures;
+        check.check();
+        printf("%s %s\n", failures == before ? "ok    " : "FAILED", check.name);
+        failed += failures != before;
+    }
+    printf("%d of %zu checks failed\n", failed, sizeof(checks) / sizeof(checks[0]));
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "i2c_bus.h"
+
+/*
+ * Takes measurements from a register-triggered sensor described by a protocol struct (e.g.
+ * Sen0590Protocol in dfrobot-sen0590/sen0590_protocol.h) on the host. It follows the same steps as
+ * TriggeredI2CSensor does on the ESP - write the trigger, wait, then read the payload from the data
+ * register and check it's plausible - but blocks while it waits, which is fine off-target.
+ */
+template<typename Protocol>
+class TriggeredSensorReader {
+    public:
+    using Payload = typename Protocol::Payload;
+
+    TriggeredSensorReader(I2CBus *bus, uint8_t address = Protocol::default_address) : bus(bus), address(address) {}
+
+    // Take a measurement, SHORT is also returned if the payload isn't plausible
+    I2CStatus read(Payload &payload) {
+        I2CStatus status = bus->write_register(address, Protocol::trigger_register, Protocol::trigger_value);
+        if (status != I2CStatus::OK) {
+            return status;
+        }
+        bus->wait(Protocol::wait_period);
+        status = bus->read_register(address, Protocol::data_register, (uint8_t *) &payload, sizeof(payload));
+        if (status != I2CStatus::OK) {
+            return status;
+        }
+        return Protocol::plausible(payload) ? I2CStatus::OK : I2CStatus::SHORT;
+    }
+
+    protected:
+    I2CBus *bus;
+    uint8_t address;
+};
@@ -0,0 +1,209 @@
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "esphome.h"
+#include "simulated_sensors.h"
+#include "sen0590.h"
+#include "tinovi_leaf_wetness.h"
+
+/*
+ * Measures the worst case execution time of each step of the components' loop() (see
+ * common/triggered_i2c_sensor.h) under bad conditions, on a simulated bus with the ESPHome stub:
+ *
+ * ```
+ * wcet_harness [hours] [seed]
+ * ```
+ *
+ * A SEN0590 and a Tinovi leaf sensor share a 100kHz bus through an I2CScheduler, as in the example
+ * in common/i2c_scheduler.h, with the main loop passing every 16ms or a little later (as if other
+ * components had run). The SEN0590 averages several measurements taken back to back for each
+ * distance it publishes, as many as its noisy target needs (see dfrobot-sen0590/sen0590.h), so the
+ * sensors' transactions drift in and out of step and they sometimes wait for each other. ESPHome
+ * runs components in the order they're registered, and the first to ask in a pass gets the bus, so
+ * they're run in a random order each pass to cover either order. The bus NACKs, reads nothing,
+ * stretches the clock for 2ms and hangs until a 50ms timeout at random, and each sensor is unplugged
+ * for a while every 10 minutes so they go offline, are probed and run their self-test again. Logging
+ * costs what it would on a 115200 baud UART.
+ *
+ * The time is simulated: it's the time each call would spend on the bus and logging on the device,
+ * not the time the code itself takes, which is a few tens of us on an ESP8266. Each call's time is
+ * counted against the step it started in, as the components' own LoopTiming does, and the exact
+ * worst and 99.9th percentile of each step are reported alongside the bound LoopTiming gives for
+ * the percentile. It fails if a step wasn't exercised or LoopTiming disagrees.
+ */
+
+#define LOOP_INTERVAL 16000
+// The most a pass can run late by in us
+#define LOOP_JITTER 8000
+#define PLUG_PERIOD 600000000ULL
+#define UART_US_PER_BYTE 87
+// The distance the SEN0590 measures in mm, give or take the noise, which changes every minute
+#define DISTANCE 1234
+#define MAX_NOISE 40
+
+static const char *const steps[] = {"REQUEST", "WAITING", "READY", "READ", "IDLE", "OFFLINE"};
+
+// The exact distribution of the times one step took
+struct StepTimes {
+    std::map<uint32_t, uint64_t> counts; // The number of calls which took each time in us
+    uint64_t runs = 0;
+
+    void add(uint32_t elapsed) {
+        counts[elapsed]++;
+        runs++;
+    }
+    uint32_t worst() const { return counts.empty() ? 0 : counts.rbegin()->first; }
+    // The time `permille` thousandths of the calls took at most
+    uint32_t percentile(uint32_t permille) const {
+        uint64_t target = (runs * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (const auto &count : counts) {
+            seen += count.second;
+            if (seen >= target) {
+                return count.first;
+            }
+        }
+        return worst();
+    }
+};
+
+// A component being measured, with the device it talks to
+template<typename Component>
+struct Subject {
+    Subject(Component &component, SimulatedI2CBus &bus, SimulatedI2CDevice *device, uint64_t unplugAt,
+            uint64_t unpluggedFor)
+        : component(component), bus(bus), device(device), unplugAt(unplugAt), unpluggedFor(unpluggedFor) {}
+
+    Component &component;
+    SimulatedI2CBus &bus;
+    SimulatedI2CDevice *device;
+    uint64_t unplugAt; // When in each PLUG_PERIOD the sensor is unplugged in us
+    uint64_t unpluggedFor; // How long it stays unplugged in us
+    uint64_t nextUpdate = 0;
+    bool plugged = true;
+    bool online = false;
+    uint32_t offline = 0; // The number of times it went offline
+    StepTimes times[TRIGGERED_SENSOR_STEPS];
+
+    void plug() {
+        bool unplug = host_clock_us % PLUG_PERIOD - unplugAt < unpluggedFor;
+        if (unplug == plugged) {
+            plugged = !unplug;
+            if (plugged) {
+                bus.attach(component.address, device);
+            } else {
+                bus.detach(component.address);
+            }
+        }
+    }
+
+    void loop() {
+        uint8_t started = (uint8_t) component.step;
+        uint64_t start = host_clock_us;
+        component.loop();
+        times[started].add((uint32_t) (host_clock_us - start));
+        if (online && !component.online) {
+            offline++;
+        }
+        online = component.online;
+        if (host_clock_us >= nextUpdate) {
+            component.update();
+            nextUpdate += component.get_update_interval() * 1000ULL;
+        }
+    }
+
+    // Print the steps' times, returning false if one wasn't exercised or LoopTiming disagrees
+    bool report(const char *name, uint32_t measurements, uint32_t failures) {
+        printf("%s at 0x%02X: %u measurements, %u failed, offline %u times\n", name, (unsigned) component.address,
+               (unsigned) measurements, (unsigned) failures, (unsigned) offline);
+        printf("  %-8s %10s %9s %9s %16s\n", "step", "calls", "worst us", "p99.9 us", "LoopTiming p99.9");
+        bool ok = true;
+        for (uint8_t i = 0; i < TRIGGERED_SENSOR_STEPS; i++) {
+            const StepTimes &step = times[i];
+            const LoopTiming &timing = component.timing[i];
+            // READ is entered and left within the call which gets the bus, so no call starts in it
+            if (i == (uint8_t) TriggeredSensorState::READ) {
+                printf("  %-8s %10s (counted against the step the read started in)\n", steps[i], "-");
+                continue;
+            }
+            bool agrees = timing.count == step.runs && timing.worst == step.worst() &&
+                timing.percentile(999) >= step.percentile(999);
+            printf("  %-8s %10llu %9u %9u %16s%s\n", steps[i], (unsigned long long) step.runs,
+                   (unsigned) step.worst(), (unsigned) step.percentile(999),
+                   ("under " + std::to_string(timing.percentile(999))).c_str(),
+                   step.runs == 0 ? "  NOT EXERCISED" : agrees ? "" : "  LOOPTIMING DISAGREES");
+            ok = ok && step.runs > 0 && agrees;
+        }
+        return ok;
+    }
+};
+
+int main(int argc, char **argv) {
+    double hours = argc > 1 ? strtod(argv[1], nullptr) : 24;
+    uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+    uint64_t end = (uint64_t) (hours * 3600e6);
+    srand(seed);
+
+    SimulatedI2CBus bus(100000, &host_clock_us);
+    bus.seed = seed == 0 ? 1 : seed;
+    bus.faults.nack = 5;
+    bus.faults.shortRead = 5;
+    bus.faults.stretch = 20;
+    bus.faults.stretchMicros = 2000;
+    bus.faults.timeout = 1;
+    bus.faults.timeoutMicros = 50000;
+    host_log_us_per_byte = UART_US_PER_BYTE;
+
+    SimulatedSen0590 distance;
+    uint32_t noise = 0;
+    SimulatedLeafSensor leaf;
+    leaf.set(4200, 2150);
+
+    static I2CScheduler scheduler(60000);
+    static LeafWetness leafComponent(5000);
+    static Sen0590 distanceComponent(1000);
+    leafComponent.set_bus(&bus);
+    distanceComponent.set_bus(&bus);
+    leafComponent.set_scheduler(&scheduler, 1, 500);
+    distanceComponent.set_scheduler(&scheduler, 10, 20);
+    distanceComponent.set_adaptive_averaging(1, 8, 5, 15);
+    Subject<LeafWetness> leafSubject{leafComponent, bus, &leaf, 120000000, 30000000};
+    Subject<Sen0590> distanceSubject{distanceComponent, bus, &distance, 420000000, 20000000};
+    leafSubject.plug();
+    distanceSubject.plug();
+
+    scheduler.setup();
+    leafComponent.setup();
+    distanceComponent.setup();
+    uint64_t nextReport = 60000000;
+    while (host_clock_us < end) {
+        uint64_t pass = host_clock_us;
+        distance.set(DISTANCE + (noise == 0 ? 0 : rand() % (2 * noise + 1) - noise));
+        scheduler.loop();
+        if (rand() % 2 == 0) {
+            leafSubject.loop();
+            distanceSubject.loop();
+        } else {
+            distanceSubject.loop();
+            leafSubject.loop();
+        }
+        if (host_clock_us >= nextReport) {
+            scheduler.update();
+            nextReport += 60000000;
+            noise = rand() % (MAX_NOISE + 1);
+        }
+        leafSubject.plug();
+        distanceSubject.plug();
+        // The next pass starts 16ms after this one did, plus the jitter, or straight away if this one
+        // overran
+        host_clock_us = std::max(host_clock_us, pass + LOOP_INTERVAL + rand() % LOOP_JITTER);
+    }
+
+    printf("%.1f hours at 100kHz, a pass every %u ms, seed %u: %u bus transactions, %u failed\n", hours,
+           (unsigned) (LOOP_INTERVAL / 1000), (unsigned) seed, (unsigned) bus.stats.transactions,
+           (unsigned) bus.stats.failures);
+    bool ok = distanceSubject.report("Sen0590", distanceComponent.publishes, distanceComponent.metrics.errors);
+    ok = leafSubject.report("LeafWetness", leafComponent.wetness_sensor.publishes, leafComponent.metrics.errors) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""
+Builds each component in a minimal ESPHome configuration for ESP8266 and ESP32 and reports the
+flash, IRAM and DRAM it uses over an empty configuration for the same platform.
+
+Each variant is a component with a set of features turned on (build flags), so the cost of each
+feature is the difference between two variants. The sizes are compared with baseline.json and the
+script exits with an error if any of them has grown by more than the tolerance, or has no baseline
+to compare with (there is no baseline.json, or it hasn't got the variant) unless --update-baseline
+is given.
+
+    ./size_report.py                     # build everything and compare with the baseline
+    ./size_report.py --variant sen0590   # only build some variants
+    ./size_report.py --update-baseline   # record the current sizes as the baseline
+
+It needs `esphome` on the path; the builds are done in _size_build/.
+"""
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+REPO = os.path.dirname(HERE)
+BUILD = os.path.join(HERE, "_size_build")
+BASELINE = os.path.join(HERE, "baseline.json")
+
+PLATFORMS = {
+    "esp8266": {"board": "d1_mini", "sda": "GPIO4", "scl": "GPIO5"},
+    "esp32": {"board": "esp32dev", "sda": "GPIO21", "scl": "GPIO22"},
+}
+
+# Which ELF sections count towards which memory, per platform
+SECTIONS = {
+    "esp8266": {
+        "flash": [".irom0.text", ".text", ".data", ".rodata"],
+        "iram": [".text"],
+        "dram": [".data", ".rodata", ".bss"],
+    },
+    "esp32": {
+        "flash": [".flash.text", ".flash.rodata", ".iram0.text", ".iram0.vectors", ".dram0.data"],
+        "iram": [".iram0.text", ".iram0.vectors"],
+        "dram": [".dram0.data", ".dram0.bss"],
+    },
+}
+
+COMMON = ["common/fixed_calibration.h", "common/hot_path.h", "common/i2c_bus.h", "common/i2c_scheduler.h", "common/loop_timing.h", "common/protothread.h", "common/rollup.h", "common/rollup_sensors.h", "common/sample_history.h", "common/sensor_metrics.h", "common/triggered_i2c_sensor.h", "common/wire_bus.h"]
+SEN0590 = COMMON + ["dfrobot-sen0590/sen0590_protocol.h", "dfrobot-sen0590/sen0590.h"]
+LEAF_WETNESS = COMMON + [
+    "tinovi-leaf-sensor/tinovi_leaf_wetness.h",
+    "tinovi-leaf-sensor/LeafArduinoI2c/LeafSens.h",
+]
+LEAF_SENS = ["common/hot_path.h", "common/i2c_bus.h", "common/wire_bus.h", "tinovi-leaf-sensor/LeafArduinoI2c/LeafSens.h", "tinovi-leaf-sensor/LeafArduinoI2c/LeafSens.cpp"]
+
+SEN0590_LAMBDA = """
+      static Sen0590 sensor(5000);
+      App.register_component(&sensor);
+      return {&sensor};"""
+SEN0590_SENSORS = ["Distance"]
+LEAF_WETNESS_LAMBDA = """
+      static LeafWetness sensor(5000);
+      App.register_component(&sensor);
+      return {&sensor.temperature_sensor, &sensor.wetness_sensor};"""
+LEAF_WETNESS_SENSORS = ["Temperature", "Wetness"]
+
+# name: (includes, build flags, sensor lambda, sensor names, on_boot lambda)
+VARIANTS = {
+    "base": ([], [], None, [], None),
+    "sen0590": (SEN0590, [], SEN0590_LAMBDA, SEN0590_SENSORS, None),
+    "sen0590_hot_iram": (SEN0590, ["CUSTOM_COMPONENTS_HOT_IRAM"], SEN0590_LAMBDA, SEN0590_SENSORS, None),
+    "sen0590_raw": (SEN0590, ["CUSTOM_COMPONENTS_RAW_CHANNELS"], SEN0590_LAMBDA, SEN0590_SENSORS, None),
+    "sen0590_metrics": (SEN0590, ["CUSTOM_COMPONENTS_METRICS"], SEN0590_LAMBDA, SEN0590_SENSORS, None),
+    "sen0590_loop_timing": (SEN0590, ["CUSTOM_COMPONENTS_LOOP_TIMING"], SEN0590_LAMBDA, SEN0590_SENSORS, None),
+    "leaf_wetness": (LEAF_WETNESS, [], LEAF_WETNESS_LAMBDA, LEAF_WETNESS_SENSORS, None),
+    "leaf_wetness_raw": (LEAF_WETNESS, ["CUSTOM_COMPONENTS_RAW_CHANNELS"], LEAF_WETNESS_LAMBDA, LEAF_WETNESS_SENSORS, None),
+    "leaf_wetness_rollups": (LEAF_WETNESS, ["CUSTOM_COMPONENTS_ROLLUPS"], LEAF_WETNESS_LAMBDA, LEAF_WETNESS_SENSORS, None),
+    "leaf_wetness_history": (LEAF_WETNESS, ["CUSTOM_COMPONENTS_HISTORY"], LEAF_WETNESS_LAMBDA, LEAF_WETNESS_SENSORS, None),
+    "leaf_wetness_hot_iram": (LEAF_WETNESS, ["CUSTOM_COMPONENTS_HOT_IRAM"], LEAF_WETNESS_LAMBDA, LEAF_WETNESS_SENSORS, None),
+    "leaf_sens": (LEAF_SENS, [], None, [], """
+      static LeafSens leaf;
+      leaf.init(0x61, &Wire);
+      leaf.newReading();
+      ESP_LOGI("leaf_sens", "%f %f", leaf.getWet(), leaf.getTemp());"""),
+    "sen0590_scheduled": (SEN0590, [], """
+      static I2CScheduler bus(60000);
+      static Sen0590 sensor(5000);
+      App.register_component(&bus);
+      App.register_component(&sensor);
+      sensor.set_scheduler(&bus, 1, 100);
+      return {&sensor};""", SEN0590_SENSORS, None),
+    "sen0590_clocked": (SEN0590 + ["common/acquisition_clock.h"], [], """
+      static AcquisitionClock clock(5000);
+      static Sen0590 sensor(5000);
+      App.register_component(&clock);
+      App.register_component(&sensor);
+      clock.add(&sensor);
+      return {&sensor};""", SEN0590_SENSORS, None),
+}
+
+
+def config(variant, platform):
+    includes, flags, lambda_, sensors, on_boot = VARIANTS[variant]
+    pins = PLATFORMS[platform]
+    lines = [
+        "esphome:",
+        "  name: size-%s-%s" % (variant.replace("_", "-"), platform),
+    ]
+    if includes:
+        lines.append("  includes:")
+        lines += ["    - %s" % os.path.join(REPO, include) for include in includes]
+    if flags:
+        lines += ["  platformio_options:", "    build_flags:"]
+        lines += ["      - -D%s" % flag for flag in flags]
+    if on_boot:
+        lines += ["  on_boot:", "    then:", "      - lambda: |-"]
+        lines += ["    " + line for line in on_boot.strip("\n").split("\n")]
+    lines += [
+        "%s:" % platform,
+        "  board: %s" % pins["board"],
+        "logger:",
+        "i2c:",
+        "  sda: %s" % pins["sda"],
+        "  scl: %s" % pins["scl"],
+    ]
+    if lambda_:
+        lines += ["sensor:", "  - platform: custom", "    lambda: |-"]
+        lines += [line for line in lambda_.strip("\n").split("\n")]
+        lines.append("    sensors:")
+        lines += ["      - name: %s" % name for name in sensors]
+    return "\n".join(lines) + "\n"
+
+
+def size_tool(platform):
+    pattern = "xtensa-lx106-elf-size" if platform == "esp8266" else "xtensa-esp32-elf-size"
+    tools = glob.glob(os.path.expanduser("~/.platformio/packages/*/bin/" + pattern))
+    if not tools:
+        sys.exit("Can't find %s, has a %s build been done?" % (pattern, platform))
+    return tools[0]
+
+
+def build(variant, platform):
+    name = "size-%s-%s" % (variant.replace("_", "-"), platform)
+    path = os.path.join(BUILD, name + ".yaml")
+    with open(path, "w") as f:
+        f.write(config(variant, platform))
+    subprocess.run(["esphome", "compile", path], check=True, stdout=subprocess.DEVNULL)
+    elf = os.path.join(BUILD, ".esphome", "build", name, ".pioenvs", name, "firmware.elf")
+    output = subprocess.run([size_tool(platform), "-A", elf], check=True, capture_output=True, text=True).stdout
+    sections = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    return {memory: sum(sections.get(section, 0) for section in names)
+            for memory, names in SECTIONS[platform].items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--platform", action="append", choices=sorted(PLATFORMS))
+    parser.add_argument("--variant", action="append", choices=sorted(VARIANTS))
+    parser.add_argument("--tolerance", type=int, default=64, help="bytes a size can grow by (default 64)")
+    parser.add_argument("--update-baseline", action="store_true")
+    args = parser.parse_args()
+
+    os.makedirs(BUILD, exist_ok=True)
+    platforms = args.platform or sorted(PLATFORMS)
+    variants = ["base"] + [variant for variant in (args.variant or VARIANTS) if variant != "base"]
+    baseline = {}
+    if os.path.exists(BASELINE):
+        with open(BASELINE) as f:
+            baseline = json.load(f)
+    elif not args.update_baseline:
+        # Fail before the builds, they take a while
+        sys.exit("There is no %s, run with --update-baseline to record one" % BASELINE)
+
+    results = {}
+    regressions = []
+    for platform in platforms:
+        base = build("base", platform)
+        print("%-8s %-20s %8s %8s %8s" % (platform, "variant", "flash", "iram", "dram"))
+        for variant in variants:
+            sizes = base if variant == "base" else build(variant, platform)
+            if variant != "base":
+                sizes = {memory: sizes[memory] - base[memory] for memory in sizes}
+            key = "%s/%s" % (platform, variant)
+            results[key] = sizes
+            print("%-8s %-20s %8d %8d %8d" % ("", variant, sizes["flash"], sizes["iram"], sizes["dram"]))
+            # The base size depends on the ESPHome version, only the components' costs are checked
+            if variant == "base":
+                continue
+            if key not in baseline:
+                if not args.update_baseline:
+                    regressions.append("%s has no baseline, run with --update-baseline to record one" % key)
+                continue
+            for memory, size in sizes.items():
+                if size > baseline[key][memory] + args.tolerance:
+                    regressions.append("%s %s grew from %d to %d bytes" % (key, memory, baseline[key][memory], size))
+
+    if args.update_baseline:
+        baseline.update(results)
+        with open(BASELINE, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("Updated %s" % BASELINE)
+    if regressions:
+        print("\n".join(regressions))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -6,95 +6,72 @@
 
 
 LeafSens::LeafSens(){
+  _bus = nullptr;
   addr=0x61;
 }
 
-int LeafSens::init(uint8_t address, TwoWire *the_wire){
-  _wire = the_wire;
+int LeafSens::init(uint8_t address, I2CBus *bus){
+  _bus = bus;
   addr = address;
   return 0;
 }
 
-int LeafSens::init(uint8_t address){
-  _wire = &Wire;
-  _wire->begin();
-  // _wire->setClock(100000L);
-  addr = address;
-  return 0;
+#ifdef ARDUINO
+int LeafSens::init(uint8_t address, TwoWire *the_wire){
+  _wireBus = WireBus(the_wire);
+  return init(address, &_wireBus);
 }
 
-
-bool LeafSens::i2cdelay(int size){
-  delay(1);
-  int i=0;
-  for (;_wire->available() < size && i<=size;i++) {
-	  delay(2);
-  }
-  if(i>=size){
-	  return false;
-  }else{
-	  return true;
-  }
+int LeafSens::init(uint8_t address){
+  Wire.begin();
+  // Wire.setClock(100000L);
+  return init(address, &Wire);
 }
+#endif
+
 
 int LeafSens::getState(){ //-1:no data, 0:err, 1:ok
-  _wire->requestFrom(addr, (uint8_t)1);
-   if(i2cdelay(1)){
-    return _wire->read();
+  uint8_t state;
+  if(_bus->read(addr, &state, 1) == I2CStatus::OK){
+    return state;
   }else{
     return -1;
   }
 }
 
-int16_t LeafSens::getVal(byte reg){
+// Select a register, give the sensor time to prepare it, then read it
+bool LeafSens::readReg(uint8_t reg, uint8_t data[], uint8_t size){
+  _bus->write_register(addr, reg);
+  _bus->wait(10);
+  return _bus->read(addr, data, size) == I2CStatus::OK;
+}
 
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(reg);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(10);
-  _wire->requestFrom(addr, (uint8_t)2);
-  int16_t ret=0;
-  if(i2cdelay(2)){
-	byte *pointer = (byte *)&ret;
-    pointer[0] = _wire->read();
-    pointer[1] = _wire->read();
+int16_t LeafSens::getVal(uint8_t reg){
+  uint8_t data[2];
+  if(!readReg(reg, data, 2)){
+    return 0;
   }
-  return ret;
-}
-
-uint32_t LeafSens::getVal32(byte reg){
-
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(reg);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(10);
-  _wire->requestFrom(addr, (uint8_t)4);
-  int16_t ret=0;
-  if(i2cdelay(4)){
-	byte *pointer = (byte *)&ret;
-    pointer[0] = _wire->read();
-    pointer[1] = _wire->read();
-    pointer[2] = _wire->read();
-    pointer[3] = _wire->read();
+  return (int16_t)(data[0] | (data[1] << 8));
+}
+
+uint32_t LeafSens::getVal32(uint8_t reg){
+  uint8_t data[4];
+  if(!readReg(reg, data, 4)){
+    return 0;
   }
-  return ret;
+  return data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
 }
 
 
-int LeafSens::setReg8(byte reg, byte val){
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(reg);              // sends one byte
-  _wire->write(val);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(10);
+int LeafSens::setReg8(uint8_t reg, uint8_t val){
+  _bus->write_register(addr, reg, val);
+  _bus->wait(10);
   return getState();
 }
 
-int LeafSens::setReg(byte reg){
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(reg);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(2);
+int LeafSens::setReg(uint8_t reg){
+  _bus->write_register(addr, reg);
+  _bus->wait(2);
   return getState();
 }
 
@@ -111,7 +88,7 @@ int LeafSens::calibrationAir(){
 int LeafSens::calibrationWater(){
   return setReg(REG_WATER);
 }
-int LeafSens::newAddress(byte newAddr){
+int LeafSens::newAddress(uint8_t newAddr){
   if(setReg8(REG_ADDR, newAddr)){
     addr = newAddr;
   }
@@ -122,10 +99,8 @@ int LeafSens::newAddress(byte newAddr){
 }
 
 int LeafSens::newReading(){
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(REG_READ_ST);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(200); // let sensor read the data
+  _bus->write_register(addr, REG_READ_ST);
+  _bus->wait(200); // let sensor read the data
   return getState();
 }
 
@@ -150,17 +125,10 @@ uint32_t  LeafSens::getRt(){
 }
 
 void LeafSens::getData(float readings[]){
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(REG_DATA);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(10);
-  _wire->requestFrom(addr, (uint8_t)4);
-  if(i2cdelay(4)){
+  uint8_t data[4];
+  if(readReg(REG_DATA, data, 4)){
 	  for (int k = 0; k < 2; k++){
-		  int16_t ret;
-		  byte *pointer = (byte *)&ret;
-		  pointer[0] = _wire->read();
-		  pointer[1] = _wire->read();
+		  int16_t ret = (int16_t)(data[k * 2] | (data[k * 2 + 1] << 8));
       readings[k] = ret / 100.0;
 	  }
   }else{
@@ -170,17 +138,8 @@ void LeafSens::getData(float readings[]){
   }
 }
 
-void LeafSens::getRaw(byte data[]){
-  _wire->beginTransmission(addr); // transmit to device
-  _wire->write(REG_DATA);              // sends one byte
-  _wire->endTransmission();    // stop transmitting
-  delay(10);
-  _wire->requestFrom(addr, (uint8_t)4);
-  if(i2cdelay(4)){
-	  for(int i = 0; i<4; i++){
-		  data[i] = _wire->read();
-	  }
-  }else{
+void LeafSens::getRaw(uint8_t data[]){
+  if(!readReg(REG_DATA, data, 4)){
 	  for(int i = 0; i<4; i++){
 		  data[i] = 0;
 	  }
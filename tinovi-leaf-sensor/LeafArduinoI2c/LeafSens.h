@@ -6,8 +6,13 @@
 #ifndef VCLL_H_
 #define VCLL_H_
 
+#include <stdint.h>
+#include "i2c_bus.h"
+#ifdef ARDUINO
 #include <Arduino.h>
 #include <Wire.h>
+#include "wire_bus.h"
+#endif
 
 #define  REG_READ_ST    0x01
 #define  REG_TEMP    0x04
@@ -23,13 +28,18 @@
 #define REG_ADDR 0x08
 #define  REG_DATA     0x09
 
+// The sensor is reached through an I2CBus (see common/i2c_bus.h), so it can be used from a Linux
+// host through /dev/i2c-N as well as from Arduino
 class LeafSens
 {
 public:
   LeafSens();
+  int init(uint8_t address, I2CBus *bus);
+#ifdef ARDUINO
   int init(uint8_t address, TwoWire *the_wire);
   int init(uint8_t address);
-  int newAddress(byte newAddr);
+#endif
+  int newAddress(uint8_t newAddr);
   int resetDefault();
   int calibrationAir();
   int calibrationWater();
@@ -37,21 +47,23 @@ public:
   float getWet();
   float getTemp();
   void getData(float retVal[]);
-  void getRaw(byte data[]);
+  void getRaw(uint8_t data[]);
   int16_t getCap();
   uint32_t getRt();
 
 private:
-  TwoWire *_wire;
+  I2CBus *_bus;
+#ifdef ARDUINO
+  WireBus _wireBus;
+#endif
   uint8_t addr;
   int getState();
-  int16_t getVal(byte reg);
-  uint32_t getVal32(byte reg);
-  int setReg8(byte reg, byte val);
-  int setReg(byte reg);
-  bool i2cdelay(int size);
+  int16_t getVal(uint8_t reg);
+  uint32_t getVal32(uint8_t reg);
+  int setReg8(uint8_t reg, uint8_t val);
+  int setReg(uint8_t reg);
+  bool readReg(uint8_t reg, uint8_t data[], uint8_t size);
 
 };
 
 #endif /* VCLL_H_ */
-
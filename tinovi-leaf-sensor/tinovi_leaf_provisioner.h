@@ -0,0 +1,214 @@
+#pragma once
+#include "esphome.h"
+#include "i2c_bus.h"
+#include "protothread.h"
+#include "LeafSens.h"
+#include "tinovi_leaf_wetness.h"
+#ifdef ARDUINO
+#include "wire_bus.h"
+#endif
+
+// The most sensors that can be provisioned in one session
+#define LEAF_PROVISIONER_MAX_SENSORS 32
+// How often to look for a sensor at the default address in ms
+#define LEAF_PROVISIONER_INTERVAL 1000
+
+/*
+ * Gives Tinovi leaf sensors their own I2C addresses so that many of them can share one bus.
+ * They all ship at 0x61, and LeafSens::newAddress() can change the address but there's nothing
+ * that uses it - this component does the same register write without blocking.
+ *
+ * While it's running it keeps looking for a sensor at 0x61. When it finds one it moves it to the
+ * next free address (starting from `firstAddress` and skipping any address which already answers),
+ * checks it now answers there and not at 0x61, and logs the custom sensor which reads all the
+ * sensors provisioned so far. Sensors can be connected one at a time, or behind a TCA9548A style
+ * multiplexer in which case each of its channels is checked in turn, and the logged configuration
+ * puts each sensor on its channel with a TCA9548AChannel bus (see common/tca9548a_bus.h, which
+ * needs adding to the includes). Once all the sensors have been provisioned, replace the
+ * provisioner's sensor in the configuration with the logged one. Like the sensors it uses the Wire
+ * global unless it's given another bus with set_bus().
+ *
+ * Add the includes under `esphome:` (as well as the ones for LeafWetness)
+ *
+ * ```
+ * includes:
+ *   - custom_components/tinovi-leaf-sensor/tinovi_leaf_provisioner.h
+ * ```
+ *
+ * and the provisioner to a lambda which is run at setup, e.g. the custom sensor:
+ *
+ * ```
+ * sensor:
+ *   - platform: custom
+ *     lambda: |-
+ *       static LeafWetnessProvisioner provisioner(0x62);
+ *       // provisioner.set_multiplexer(0x70); // if the sensors are behind a multiplexer
+ *       App.register_component(&provisioner);
+ *       return {};
+ *     sensors: []
+ * ```
+ *
+ * The log then shows, after each sensor is moved:
+ *
+ * ```
+ * [I][tinovi_leaf_provisioner]: Moved the sensor at 0x61 on channel 3 to 0x62
+ * [I][tinovi_leaf_provisioner]: 1 sensors provisioned, replace the provisioner's sensor with:
+ * [I][tinovi_leaf_provisioner]:   - platform: custom
+ * [I][tinovi_leaf_provisioner]:     lambda: |-
+ * [I][tinovi_leaf_provisioner]:       static TCA9548A mux(wire_bus(), 0x70);
+ * [I][tinovi_leaf_provisioner]:       static TCA9548AChannel mux_3(&mux, 3);
+ * [I][tinovi_leaf_provisioner]:       static LeafWetness leaf_62(5000, 0x62);
+ * [I][tinovi_leaf_provisioner]:       leaf_62.set_bus(&mux_3);
+ * [I][tinovi_leaf_provisioner]:       App.register_component(&leaf_62);
+ * [I][tinovi_leaf_provisioner]:       return {
+ * [I][tinovi_leaf_provisioner]:         &leaf_62.temperature_sensor, &leaf_62.wetness_sensor,
+ * [I][tinovi_leaf_provisioner]:       };
+ * [I][tinovi_leaf_provisioner]:     sensors:
+ * [I][tinovi_leaf_provisioner]:       - name: "Leaf 62 Temperature"
+ * [I][tinovi_leaf_provisioner]:         unit_of_measurement: °C
+ * [I][tinovi_leaf_provisioner]:         accuracy_decimals: 1
+ * [I][tinovi_leaf_provisioner]:       - name: "Leaf 62 Wetness"
+ * [I][tinovi_leaf_provisioner]:         unit_of_measurement: "%"
+ * [I][tinovi_leaf_provisioner]:         accuracy_decimals: 1
+ * ```
+ *
+ * without the multiplexer lines if there isn't one, and with the bus given to set_bus() instead of
+ * wire_bus() if it has one.
+ */
+class LeafWetnessProvisioner : public Component {
+    public:
+    LeafWetnessProvisioner(uint8_t firstAddress) : next(firstAddress) {}
+
+    Protothread thread; // Where loop() is up to
+    uint8_t next; // The next address to give a sensor
+    uint8_t target = 0; // The address being given to the sensor which has been found
+    int16_t multiplexer = -1; // The address of the multiplexer, if there is one
+    uint8_t channel = 0; // The next multiplexer channel to check
+    int8_t checking = -1; // The multiplexer channel selected, if there is a multiplexer
+    uint8_t count = 0; // The number of sensors provisioned
+    uint8_t provisioned[LEAF_PROVISIONER_MAX_SENSORS]; // The addresses they've been given
+    int8_t channels[LEAF_PROVISIONER_MAX_SENSORS]; // The multiplexer channels they're on, or -1
+#ifdef ARDUINO
+    I2CBus *bus = wire_bus(); // The bus the sensors are on, the Wire global unless set_bus() is called
+#else
+    I2CBus *bus = nullptr; // The bus the sensors are on, which has to be given with set_bus()
+#endif
+
+    // Use a bus other than the Wire global
+    void set_bus(I2CBus *bus) { this->bus = bus; }
+    // Check each channel of a multiplexer at this address for sensors
+    void set_multiplexer(uint8_t address) { multiplexer = address; }
+
+    float get_setup_priority() const override { return esphome::setup_priority::BUS; }
+
+    void setup() override {
+        if (bus == nullptr) {
+            ESP_LOGE("tinovi_leaf_provisioner", "No I2C bus, give the provisioner one with set_bus()");
+            mark_failed();
+        }
+    }
+
+    void dump_config() override {
+        ESP_LOGCONFIG("tinovi_leaf_provisioner", "Tinovi Leaf Provisioner:");
+        ESP_LOGCONFIG("tinovi_leaf_provisioner", "  First address: 0x%02X", next);
+        if (multiplexer >= 0) {
+            ESP_LOGCONFIG("tinovi_leaf_provisioner", "  Multiplexer: 0x%02X", multiplexer);
+        }
+    }
+
+    void loop() override {
+        PT_BEGIN(thread);
+        PT_WAIT_MS(thread, LEAF_PROVISIONER_INTERVAL);
+        if (multiplexer >= 0) {
+            // Check the next channel of the multiplexer
+            uint8_t mask = 1 << channel;
+            bus->write((uint8_t) multiplexer, &mask, 1);
+            checking = channel;
+            channel = (channel + 1) % 8;
+        }
+        // Look for a sensor which hasn't been provisioned
+        if (!answers(LeafWetness::default_address)) {
+            PT_RESTART(thread);
+        }
+        while (next < 0x78 && (next == LeafWetness::default_address || answers(next))) {
+            next++;
+        }
+        if (next >= 0x78 || count >= LEAF_PROVISIONER_MAX_SENSORS) {
+            ESP_LOGE("tinovi_leaf_provisioner", "Found a sensor at 0x%02X but there are no addresses left",
+                     LeafWetness::default_address);
+            PT_RESTART(thread);
+        }
+
+        // Give it the next address, the sensor takes a moment to store it
+        target = next;
+        bus->write_register(LeafWetness::default_address, REG_ADDR, target);
+        PT_WAIT_MS(thread, 50);
+
+        // Check it has moved
+        if (!answers(target) || answers(LeafWetness::default_address)) {
+            ESP_LOGE("tinovi_leaf_provisioner", "The sensor at 0x%02X didn't move to 0x%02X",
+                     LeafWetness::default_address, target);
+            PT_RESTART(thread);
+        }
+        provisioned[count] = target;
+        channels[count++] = checking;
+        next = target + 1;
+        if (checking >= 0) {
+            ESP_LOGI("tinovi_leaf_provisioner", "Moved the sensor at 0x%02X on channel %d to 0x%02X",
+                     LeafWetness::default_address, checking, target);
+        } else {
+            ESP_LOGI("tinovi_leaf_provisioner", "Moved the sensor at 0x%02X to 0x%02X", LeafWetness::default_address, target);
+        }
+        log_config();
+        PT_END(thread);
+    }
+
+    protected:
+    // Whether a device acknowledges the address
+    bool answers(uint8_t address) { return bus->probe(address); }
+
+    // Log the custom sensor reading all the sensors provisioned so far
+    void log_config() {
+        ESP_LOGI("tinovi_leaf_provisioner", "%u sensors provisioned, replace the provisioner's sensor with:", (unsigned) count);
+        ESP_LOGI("tinovi_leaf_provisioner", "  - platform: custom");
+        ESP_LOGI("tinovi_leaf_provisioner", "    lambda: |-");
+        // The multiplexer and each channel with sensors on it
+        uint8_t used = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (channels[i] >= 0) {
+                used |= 1 << channels[i];
+            }
+        }
+        if (used != 0) {
+            ESP_LOGI("tinovi_leaf_provisioner", "      static TCA9548A mux(wire_bus(), 0x%02X);", multiplexer);
+        }
+        for (uint8_t channel = 0; channel < 8; channel++) {
+            if (used & (1 << channel)) {
+                ESP_LOGI("tinovi_leaf_provisioner", "      static TCA9548AChannel mux_%d(&mux, %d);", channel, channel);
+            }
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            ESP_LOGI("tinovi_leaf_provisioner", "      static LeafWetness leaf_%02x(5000, 0x%02X);", provisioned[i], provisioned[i]);
+            if (channels[i] >= 0) {
+                ESP_LOGI("tinovi_leaf_provisioner", "      leaf_%02x.set_bus(&mux_%d);", provisioned[i], channels[i]);
+            }
+            ESP_LOGI("tinovi_leaf_provisioner", "      App.register_component(&leaf_%02x);", provisioned[i]);
+        }
+        // A line for each sensor, as one line for them all could be longer than the log allows
+        ESP_LOGI("tinovi_leaf_provisioner", "      return {");
+        for (uint8_t i = 0; i < count; i++) {
+            ESP_LOGI("tinovi_leaf_provisioner", "        &leaf_%02x.temperature_sensor, &leaf_%02x.wetness_sensor,",
+                     provisioned[i], provisioned[i]);
+        }
+        ESP_LOGI("tinovi_leaf_provisioner", "      };");
+        ESP_LOGI("tinovi_leaf_provisioner", "    sensors:");
+        for (uint8_t i = 0; i < count; i++) {
+            ESP_LOGI("tinovi_leaf_provisioner", "      - name: \"Leaf %02x Temperature\"", provisioned[i]);
+            ESP_LOGI("tinovi_leaf_provisioner", "        unit_of_measurement: °C");
+            ESP_LOGI("tinovi_leaf_provisioner", "        accuracy_decimals: 1");
+            ESP_LOGI("tinovi_leaf_provisioner", "      - name: \"Leaf %02x Wetness\"", provisioned[i]);
+            ESP_LOGI("tinovi_leaf_provisioner", "        unit_of_measurement: \"%%\"");
+            ESP_LOGI("tinovi_leaf_provisioner", "        accuracy_decimals: 1");
+        }
+    }
+};
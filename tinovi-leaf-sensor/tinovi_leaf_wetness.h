@@ -1,24 +1,27 @@
-#include "Wire.h"
+#pragma once
 #include "esphome.h"
+#include "triggered_i2c_sensor.h"
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+#include "rollup_sensors.h"
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+#include "sample_history.h"
+#endif
 #include "LeafSens.h"
 
-#define address 0x61 // default address for the sensor
-#define wait_period 300 // the time in ms to wait to read the data after requesting a new reading - this is stated by the docs as 100ms, but in the code it's either 300ms or 400ms. 300ms seems to work.
-
-// The various states the component can be in
-enum LeafWetnessSensorState { 
-    REQUEST, // Request a new measurement
-    WAITING, // Waiting for the measurement
-    READY, // Ready to request the measurement value
-    READ, // Requesting the measurement value
-    IDLE // There is no request in progress
+// A measurement as sent by the sensor, both values are little-endian like the ESP so the bytes can
+// be read straight into it
+struct LeafWetnessPayload {
+    int16_t wetness; // Hundredths of a %
+    int16_t temperature; // Hundredths of a degree celsius
 };
 
 /*
  * An ESPHome component for the I2C leaf sensor made by Tinovi. 
  * It's based on their Arduino example code which is in LeadArduioI2C but replaces the various delays
- * they use with a very basic state machine, and uses millis() to work out when the sensor is ready
- * to avoid blocking the loop.
+ * they use with a protothread which waits for the sensor to be ready without blocking the loop. The
+ * protothread is generated by TriggeredI2CSensor (see common/triggered_i2c_sensor.h) from the
+ * description of the sensor below.
  * 
  * It publishes both the temperature reading in (degrees celsius) and the wetness reading (%).
  *
@@ -35,6 +38,18 @@ enum LeafWetnessSensorState {
  * 
  * ```
  * includes:
+ *   - custom_components/common/hot_path.h
+ *   - custom_components/common/fixed_calibration.h
+ *   - custom_components/common/i2c_bus.h
+ *   - custom_components/common/i2c_scheduler.h
+ *   - custom_components/common/loop_timing.h
+ *   - custom_components/common/protothread.h
+ *   - custom_components/common/triggered_i2c_sensor.h
+ *   - custom_components/common/wire_bus.h
+ *   - custom_components/common/rollup.h
+ *   - custom_components/common/rollup_sensors.h
+ *   - custom_components/common/sample_history.h
+ *   - custom_components/common/sensor_metrics.h
  *   - custom_components/tinovi-leaf-sensor/tinovi_leaf_wetness.h
  *   - custom_components/tinovi-leaf-sensor/LeafArduinoI2c/LeafSens.h
  * ```
@@ -45,9 +60,9 @@ enum LeafWetnessSensorState {
  * sensor:
  *   - platform: custom
  *     lambda: |-
- *       auto sensor = new LeafWetness(5000);
- *       App.register_component(sensor);
- *       return {sensor->temperature_sensor, sensor->wetness_sensor};
+ *       static LeafWetness sensor(5000);
+ *       App.register_component(&sensor);
+ *       return {&sensor.temperature_sensor, &sensor.wetness_sensor};
  * 
  *     sensors:
  *       - name: "Temperature Sensor"
@@ -56,80 +71,137 @@ enum LeafWetnessSensorState {
  *       - name: "Wetness Sensor"
  *         unit_of_measurement: "%"
  *         accuracy_decimals: 1
+ * ```
+ *
+ * Neither the component nor its two sensors are created with `new`: the sensors are embedded
+ * members and the component is a function-local static. ESPHome's own Sensor code does allocate
+ * (e.g. the names and callbacks set from the YAML), once at setup, and the component doesn't
+ * allocate after that (see host/heap_bench.cpp).
+ *
+ * The component itself isn't a sensor - it only publishes through its two sub-sensors - so it
+ * doesn't carry a Sensor base. The RAM used by each instance is logged by dump_config() so you can
+ * work out how many fit on a node.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_RAW_CHANNELS` the bytes read from the sensor are logged, and
+ * the values it sent are published as counts on `raw_temperature_sensor` and `raw_wetness_sensor`,
+ * so add them to the sensors returned by the lambda.
+ *
+ * Each sensor can be calibrated against lab data with `sensor.set_temperature_calibration(offset,
+ * scale, quadratic)` and `sensor.set_wetness_calibration(...)` in the lambda. They're applied in
+ * fixed point (see common/fixed_calibration.h) to the readings before they're published.
+ *
+ * The wetness is derived from capacitance, which drifts with the leaf temperature. If the drift has
+ * been measured it can be removed with `sensor.set_temperature_compensation(perDegree,
+ * perDegreeSquared, reference)`, which subtracts `perDegree * dT + perDegreeSquared * dT^2` % from
+ * the wetness, where dT is the difference between the (calibrated) temperature in the same reading
+ * and the reference temperature (25 degrees by default). This is done before the wetness
+ * calibration, so that should be measured at the reference temperature.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_ROLLUPS` the minimum, maximum and mean temperature and wetness over each minute, hour and
+ * day are kept on the device (see common/rollup.h). Publish the ones you want with e.g.
+ * `sensor.wetnessRollup.set_sensor(ROLLUP_DAY, ROLLUP_MEAN, &dailyWetness)`.
+ *
+ * When built with `-DCUSTOM_COMPONENTS_HISTORY` the last SAMPLE_HISTORY_CAPACITY readings of both
+ * are kept in `sensor.history`, which can be downloaded from the web server with
+ * common/history_export.h.
+ *
+ * If the sensor isn't at the default address (0x61) pass its address as the second argument of the
+ * constructor. If it's behind a TCA9548A style multiplexer, give it its channel as its bus with
+ * `sensor.set_bus(&channel)` (see common/tca9548a_bus.h); tinovi_leaf_provisioner.h logs these lines
+ * for the sensors it provisions.
+ *
+ * To drive it from a clock shared with other sensors, so their samples are taken together, see
+ * common/acquisition_clock.h. When it shares a bus with time-critical sensors give it a low priority
+ * with set_scheduler() so its reads don't hold them up (see common/i2c_scheduler.h).
  */
-class LeafWetness : public PollingComponent, public Sensor {
+class LeafWetness : public TriggeredI2CSensor<LeafWetness, LeafWetnessPayload> {
     public:
+    static constexpr const char *tag = "tinovi_leaf_wetness";
+    static constexpr const char *name = "Tinovi Leaf Wetness";
+    static constexpr uint8_t default_address = 0x61; // default address for the sensor
+    static constexpr uint8_t trigger_register = REG_READ_ST; // Start a measurement
+    static constexpr int16_t trigger_value = -1;
+    static constexpr uint32_t wait_period = 300; // the time in ms to wait to read the data after requesting a new reading - this is stated by the docs as 100ms, but in the code it's either 300ms or 400ms. 300ms seems to work.
+    static constexpr uint8_t data_register = REG_DATA; // Both measurements
 
-    Sensor *temperature_sensor = new Sensor(); // The ESPHome temperature sensor
-    Sensor *wetness_sensor = new Sensor(); // The ESPHome wetness sensor
-
-    unsigned long startRequest = 0UL; // The time the REQUEST state is entered
-    LeafWetnessSensorState state = IDLE; // The sensor state machine
+    Sensor temperature_sensor; // The ESPHome temperature sensor
+    Sensor wetness_sensor; // The ESPHome wetness sensor
+    FixedCalibration temperatureCalibration; // Applied to the temperature in hundredths of a degree
+    FixedCalibration wetnessCalibration; // Applied to the wetness in hundredths of a %
+    FixedCalibration wetnessDrift{0.0f, 0.0f}; // The wetness drift in hundredths of a % for a temperature difference
+    int16_t driftReference = 2500; // The temperature the drift is relative to, in hundredths of a degree
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+    Sensor raw_temperature_sensor; // The temperature as sent by the sensor, in hundredths
+    Sensor raw_wetness_sensor; // The wetness as sent by the sensor, in hundredths
+#endif
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+    RollupSensors temperatureRollup; // Minute, hour and day statistics of the temperature in hundredths
+    RollupSensors wetnessRollup; // Minute, hour and day statistics of the wetness in hundredths
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+    StaticSampleHistory<2> history{"temperature,wetness", 100}; // The latest readings in hundredths
+#endif
 
-    LeafWetness(int pollingInterval) : PollingComponent(pollingInterval) {}
+    LeafWetness(int pollingInterval, uint8_t address = default_address) : TriggeredI2CSensor(pollingInterval, address) {}
 
-    // Define when to start the component
-    float get_setup_priority() const override { 
-        return esphome::setup_priority::BUS; 
+    // Correct the temperature, the coefficients are for degrees celsius. Coefficients which don't
+    // fit the fixed point (see common/fixed_calibration.h) are logged and ignored, as are those of
+    // the other corrections
+    void set_temperature_calibration(float offset, float scale = 1.0f, float quadratic = 0.0f) {
+        if (in_range("Temperature calibration", offset * 100, scale, quadratic / 100)) {
+            temperatureCalibration = FixedCalibration(offset * 100, scale, quadratic / 100);
+        }
+    }
+    // Correct the wetness, the coefficients are for %
+    void set_wetness_calibration(float offset, float scale = 1.0f, float quadratic = 0.0f) {
+        if (in_range("Wetness calibration", offset * 100, scale, quadratic / 100)) {
+            wetnessCalibration = FixedCalibration(offset * 100, scale, quadratic / 100);
+        }
+    }
+    // Compensate the wetness for the leaf temperature, given how much the reading rises in % per
+    // degree (and per degree squared) away from the reference temperature
+    void set_temperature_compensation(float perDegree, float perDegreeSquared = 0.0f, float reference = 25.0f) {
+        if (!in_range("Temperature compensation", 0.0f, perDegree, perDegreeSquared / 100)) {
+            return;
+        }
+        wetnessDrift = FixedCalibration(0.0f, perDegree, perDegreeSquared / 100);
+        driftReference = (int16_t) (reference * 100);
     }
 
-    void setup() override {
-        // This will be called by App.setup()
-        // It includes a call to Wire.begin()
+    // The sensor works from -40 to 85 degrees, and the wetness is a percentage (with some room
+    // for calibration)
+    static bool plausible(const LeafWetnessPayload &payload) {
+        return payload.temperature >= -4000 && payload.temperature <= 8500 &&
+            payload.wetness >= -1000 && payload.wetness <= 11000;
     }
-    void update() override {
-        // This is called every pollingInterval to get a new value
-        // The work is done in loop()
-        state = REQUEST; // Put the sensor into the REQUEST state to start a measurement
+    HOT_PATH void publish_payload(const LeafWetnessPayload &payload) {
+#ifdef CUSTOM_COMPONENTS_RAW_CHANNELS
+        raw_wetness_sensor.publish_state(payload.wetness);
+        raw_temperature_sensor.publish_state(payload.temperature);
+#endif
+        // The wetness is compensated using the temperature from the same reading
+        int32_t temperature = temperatureCalibration.apply(payload.temperature);
+        int32_t wetness = wetnessCalibration.apply(payload.wetness - wetnessDrift.apply(temperature - driftReference));
+        wetness_sensor.publish_state(wetness / 100.0f);
+        temperature_sensor.publish_state(temperature / 100.0f);
+#ifdef CUSTOM_COMPONENTS_ROLLUPS
+        uint32_t now = millis();
+        wetnessRollup.add(wetness, now, 100.0f);
+        temperatureRollup.add(temperature, now, 100.0f);
+#endif
+#ifdef CUSTOM_COMPONENTS_HISTORY
+        int16_t sample[2] = {SampleHistory::clamp(temperature), SampleHistory::clamp(wetness)};
+        history.add(millis(), sample);
+#endif
     }
 
-    void loop() {
-        // The state machine
-        ESP_LOGVV("tinovi_leaf_wetness", "STATE: %d", state);
-        switch(state) {
-            case REQUEST:
-                // Tell the sensor to start a measurement
-                Wire.beginTransmission(address);
-                Wire.write(REG_READ_ST);
-                Wire.endTransmission();
-                state = WAITING;
-                startRequest = millis();
-                break;
-            case WAITING:
-                // Wait for the measurement to be complete
-                if (wait_period < millis() - startRequest) {
-                    state = READY;
-                }
-                break;
-            case READY:
-                // Tell the sensor to send the measurement
-                Wire.beginTransmission(address); 
-                Wire.write(REG_DATA);
-                Wire.endTransmission();
-                Wire.requestFrom(address, 4);
-                state = READ;
-            case READ:
-                // Read the measurement and publish it
-                if(Wire.available() == 4){
-                    for (int k = 0; k < 2; k++){
-                        int16_t ret;
-                        byte *pointer = (byte *)&ret;
-                        pointer[0] = Wire.read();
-                        pointer[1] = Wire.read();
-                        float value = ret / 100.0;
-                        switch (k) {
-                            case 0:
-                                wetness_sensor->publish_state(value);
-                                break;
-                            case 1:
-                                temperature_sensor->publish_state(value);
-                                break;
-                        }
-                    }
-                    state = IDLE;
-                }
-                break;
+    protected:
+    // Whether a correction's coefficients, in hundredths, fit the fixed point, logging them if not
+    bool in_range(const char *correction, float offset, float scale, float quadratic) {
+        if (FixedCalibration::fits(offset, scale, quadratic)) {
+            return true;
         }
-    } 
-
+        ESP_LOGE(tag, "%s %g + %g x + %g x^2 is out of range, ignoring it", correction, offset, scale, quadratic);
+        return false;
+    }
 };